@@ -0,0 +1,67 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+// Очередь ограниченной ёмкости между потоками-производителями и
+// потребителями: Push ждёт, пока в очереди появится место, Pop - пока
+// появится элемент. После Close новые элементы не принимаются, а Pop
+// отдаёт оставшиеся и затем возвращает nullopt.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity)
+        : capacity_(capacity > 0 ? capacity : 1)
+    {}
+
+    // Возвращает false, если очередь закрыта и value не принято
+    bool Push(T value) {
+        std::unique_lock lock(mutex_);
+        not_full_.wait(lock, [this] {
+            return closed_ || items_.size() < capacity_;
+        });
+        if (closed_) {
+            return false;
+        }
+        items_.push_back(std::move(value));
+        lock.unlock();
+        not_empty_.notify_one();
+        return true;
+    }
+
+    std::optional<T> Pop() {
+        std::unique_lock lock(mutex_);
+        not_empty_.wait(lock, [this] {
+            return closed_ || !items_.empty();
+        });
+        if (items_.empty()) {
+            return std::nullopt;
+        }
+        std::optional<T> value(std::move(items_.front()));
+        items_.pop_front();
+        lock.unlock();
+        not_full_.notify_one();
+        return value;
+    }
+
+    void Close() {
+        {
+            std::lock_guard lock(mutex_);
+            closed_ = true;
+        }
+        not_full_.notify_all();
+        not_empty_.notify_all();
+    }
+
+private:
+    size_t capacity_;
+    std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+    std::deque<T> items_;
+    bool closed_ = false;
+};
@@ -4,37 +4,9 @@
 #include <string>
 #include <vector>
 #include <cassert>
-#include <list>
-#include <future>
-#include <algorithm>
+#include <mutex>
 
 using namespace std::string_literals;
-using Futures = std::list<std::future<void>>;
-
-template<typename Container>
-void AsyncsWait(Container & futures) {
-    for (auto & f : futures) f.wait();
-}
-
-template<typename Container, typename Function>
-void AsyncsRun(const Container & container, Function function, Futures & futures, size_t max_threads) {
-    if (container.size() == 0) return;
-    using Iterator = typename Container::const_iterator;
-    max_threads = std::min(max_threads, container.size());
-    size_t chunk_size = container.size() / max_threads;
-    Iterator ita;
-    Iterator itb = container.begin();
-    for (size_t i = 0; i < max_threads-1; ++i) {
-        ita = itb; itb = std::next(itb, chunk_size);
-        futures.emplace_back( std::async([ita, itb, function]() {
-            std::for_each(ita, itb, function);
-        } ));
-    }
-    ita = itb; itb = container.end();
-    futures.emplace_back( std::async([ita, itb, function]() {
-        std::for_each(ita, itb, function);
-    } ));
-}
 
 template <typename Key, typename Value>
 class ConcurrentMap {
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
 #include <ostream>
 
 enum class DocumentStatus {
@@ -21,7 +23,7 @@ struct Document {
 const double RELEVANCE_CMP_EPSILON = 1.0e-6;
 
 struct CompareByRelevance {
-    bool operator()(const Document& lhs, const Document& rhs) {
+    bool operator()(const Document& lhs, const Document& rhs) const {
         if (std::abs(lhs.relevance - rhs.relevance) < RELEVANCE_CMP_EPSILON *
             std::max(std::abs(lhs.relevance), std::abs(rhs.relevance))) {
             return lhs.rating > rhs.rating;
@@ -0,0 +1,195 @@
+#include "document_bitmap.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+uint16_t HighBits(DocumentOrdinal ordinal) {
+    return static_cast<uint16_t>(ordinal >> 16);
+}
+
+uint16_t LowBits(DocumentOrdinal ordinal) {
+    return static_cast<uint16_t>(ordinal & 0xFFFFu);
+}
+
+}
+
+void DocumentBitmap::Add(DocumentOrdinal ordinal) {
+    const uint16_t key = HighBits(ordinal);
+    const uint16_t low = LowBits(ordinal);
+    // номера обычно выдаются по возрастанию, поэтому сначала проверяем последний фрагмент
+    vector<Chunk>::iterator chunk;
+    if (!chunks_.empty() && chunks_.back().key == key) {
+        chunk = prev(chunks_.end());
+    } else {
+        chunk = chunks_.begin() + (FindChunk(key) - chunks_.cbegin());
+        if (chunk == chunks_.end() || chunk->key != key) {
+            chunk = chunks_.insert(chunk, Chunk{});
+            chunk->key = key;
+        }
+    }
+
+    if (chunk->IsDense()) {
+        uint64_t & word = chunk->bits[low / 64];
+        const uint64_t mask = uint64_t{1} << (low % 64);
+        if (word & mask) {
+            return;
+        }
+        word |= mask;
+    } else {
+        auto & values = chunk->values;
+        if (values.empty() || values.back() < low) {
+            values.push_back(low);
+        } else {
+            auto it = lower_bound(values.begin(), values.end(), low);
+            if (*it == low) {
+                return;
+            }
+            values.insert(it, low);
+        }
+    }
+    ++chunk->size;
+    ++size_;
+    if (!chunk->IsDense() && chunk->size > MAX_ARRAY_SIZE) {
+        ToDense(*chunk);
+    }
+}
+
+bool DocumentBitmap::Remove(DocumentOrdinal ordinal) {
+    const uint16_t key = HighBits(ordinal);
+    const uint16_t low = LowBits(ordinal);
+    auto chunk = chunks_.begin() + (FindChunk(key) - chunks_.cbegin());
+    if (chunk == chunks_.end() || chunk->key != key) {
+        return false;
+    }
+
+    if (chunk->IsDense()) {
+        uint64_t & word = chunk->bits[low / 64];
+        const uint64_t mask = uint64_t{1} << (low % 64);
+        if (!(word & mask)) {
+            return false;
+        }
+        word &= ~mask;
+    } else {
+        auto & values = chunk->values;
+        auto it = lower_bound(values.begin(), values.end(), low);
+        if (it == values.end() || *it != low) {
+            return false;
+        }
+        values.erase(it);
+    }
+    --chunk->size;
+    --size_;
+    if (chunk->size == 0) {
+        chunks_.erase(chunk);
+    } else if (chunk->IsDense() && chunk->size <= MAX_ARRAY_SIZE / 2) {
+        // запас вдвое не даёт фрагменту менять вид на каждой операции у границы
+        ToSparse(*chunk);
+    }
+    return true;
+}
+
+bool DocumentBitmap::Contains(DocumentOrdinal ordinal) const {
+    const auto chunk = FindChunk(HighBits(ordinal));
+    return chunk != chunks_.end() && chunk->key == HighBits(ordinal) && ChunkContains(*chunk, LowBits(ordinal));
+}
+
+DocumentOrdinal DocumentBitmap::NextAtLeast(DocumentOrdinal ordinal) const {
+    const uint16_t key = HighBits(ordinal);
+    for (auto chunk = FindChunk(key); chunk != chunks_.end(); ++chunk) {
+        const uint32_t low = chunk->key == key ? LowBits(ordinal) : 0;
+        uint16_t result;
+        if (ChunkNextAtLeast(*chunk, low, result)) {
+            return (static_cast<DocumentOrdinal>(chunk->key) << 16) | result;
+        }
+    }
+    return NO_DOCUMENT;
+}
+
+size_t DocumentBitmap::CountInRange(DocumentOrdinal first, DocumentOrdinal last) const {
+    // считаем номера меньше границы и вычитаем
+    auto count_before = [this](uint64_t bound) {
+        size_t count = 0;
+        for (const Chunk & chunk : chunks_) {
+            const uint64_t chunk_first = static_cast<uint64_t>(chunk.key) << 16;
+            if (chunk_first + 65536 <= bound) {
+                count += chunk.size;
+                continue;
+            }
+            if (chunk_first >= bound) {
+                break;
+            }
+            const auto low = static_cast<uint32_t>(bound - chunk_first);
+            if (chunk.IsDense()) {
+                for (uint32_t word = 0; word < low / 64; ++word) {
+                    count += __builtin_popcountll(chunk.bits[word]);
+                }
+                if (low % 64 != 0) {
+                    count += __builtin_popcountll(chunk.bits[low / 64] & ((uint64_t{1} << (low % 64)) - 1));
+                }
+            } else {
+                count += lower_bound(chunk.values.begin(), chunk.values.end(), low) - chunk.values.begin();
+            }
+            break;
+        }
+        return count;
+    };
+    return first < last ? count_before(last) - count_before(first) : 0;
+}
+
+vector<DocumentBitmap::Chunk>::const_iterator DocumentBitmap::FindChunk(uint16_t key) const {
+    return lower_bound(chunks_.begin(), chunks_.end(), key, [](const Chunk & chunk, uint16_t value) {
+        return chunk.key < value;
+    });
+}
+
+bool DocumentBitmap::ChunkContains(const Chunk& chunk, uint16_t low) {
+    if (chunk.IsDense()) {
+        return (chunk.bits[low / 64] >> (low % 64)) & 1u;
+    }
+    return binary_search(chunk.values.begin(), chunk.values.end(), low);
+}
+
+bool DocumentBitmap::ChunkNextAtLeast(const Chunk& chunk, uint32_t low, uint16_t& result) {
+    if (!chunk.IsDense()) {
+        const auto it = lower_bound(chunk.values.begin(), chunk.values.end(), low);
+        if (it == chunk.values.end()) {
+            return false;
+        }
+        result = *it;
+        return true;
+    }
+    size_t word_index = low / 64;
+    uint64_t word = chunk.bits[word_index] & (~uint64_t{0} << (low % 64));
+    while (word == 0) {
+        if (++word_index == CHUNK_WORD_COUNT) {
+            return false;
+        }
+        word = chunk.bits[word_index];
+    }
+    result = static_cast<uint16_t>(word_index * 64 + __builtin_ctzll(word));
+    return true;
+}
+
+void DocumentBitmap::ToDense(Chunk& chunk) {
+    chunk.bits.assign(CHUNK_WORD_COUNT, 0);
+    for (const uint16_t low : chunk.values) {
+        chunk.bits[low / 64] |= uint64_t{1} << (low % 64);
+    }
+    chunk.values.clear();
+    chunk.values.shrink_to_fit();
+}
+
+void DocumentBitmap::ToSparse(Chunk& chunk) {
+    chunk.values.clear();
+    chunk.values.reserve(chunk.size);
+    for (size_t word_index = 0; word_index < CHUNK_WORD_COUNT; ++word_index) {
+        for (uint64_t word = chunk.bits[word_index]; word != 0; word &= word - 1) {
+            chunk.values.push_back(static_cast<uint16_t>(word_index * 64 + __builtin_ctzll(word)));
+        }
+    }
+    chunk.bits.clear();
+    chunk.bits.shrink_to_fit();
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "posting_list.h"
+
+#include <cstdint>
+#include <vector>
+
+// Сжатое множество номеров документов в духе Roaring: номера делятся на
+// фрагменты по старшим 16 битам, в каждом фрагменте хранится либо
+// отсортированный массив младших битов (разреженный), либо битовая карта
+// на 65536 номеров (плотный). Вид фрагмента выбирается по его мощности.
+class DocumentBitmap {
+public:
+    void Add(DocumentOrdinal ordinal);
+
+    // Возвращает true, если номер был в множестве
+    bool Remove(DocumentOrdinal ordinal);
+
+    bool Contains(DocumentOrdinal ordinal) const;
+
+    // Наименьший номер не меньше ordinal или NO_DOCUMENT
+    DocumentOrdinal NextAtLeast(DocumentOrdinal ordinal) const;
+
+    // Число номеров из [first, last)
+    size_t CountInRange(DocumentOrdinal first, DocumentOrdinal last) const;
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+private:
+    // фрагмент с массивом больше этого размера переводится в битовую карту
+    static constexpr size_t MAX_ARRAY_SIZE = 4096;
+    static constexpr size_t CHUNK_WORD_COUNT = 65536 / 64;
+
+    struct Chunk {
+        uint16_t key = 0;
+        uint32_t size = 0;
+        std::vector<uint16_t> values;
+        std::vector<uint64_t> bits;
+
+        bool IsDense() const {
+            return !bits.empty();
+        }
+    };
+
+    std::vector<Chunk> chunks_;
+    size_t size_ = 0;
+
+    // Первый фрагмент с ключом не меньше key
+    std::vector<Chunk>::const_iterator FindChunk(uint16_t key) const;
+
+    static bool ChunkContains(const Chunk& chunk, uint16_t low);
+
+    // Наименьшее значение фрагмента не меньше low; false, если его нет
+    static bool ChunkNextAtLeast(const Chunk& chunk, uint32_t low, uint16_t& result);
+
+    static void ToDense(Chunk& chunk);
+    static void ToSparse(Chunk& chunk);
+};
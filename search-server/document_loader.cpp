@@ -0,0 +1,175 @@
+#include "document_loader.h"
+#include "bounded_queue.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+
+using namespace std;
+
+namespace {
+
+bool ParseInt(string_view text, int& value) {
+    const auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+    return error == errc() && end == text.data() + text.size();
+}
+
+bool ParseStatus(string_view text, DocumentStatus& status) {
+    static const pair<string_view, DocumentStatus> statuses[] = {
+        {"ACTUAL"sv, DocumentStatus::ACTUAL},
+        {"IRRELEVANT"sv, DocumentStatus::IRRELEVANT},
+        {"BANNED"sv, DocumentStatus::BANNED},
+        {"REMOVED"sv, DocumentStatus::REMOVED},
+    };
+    for (const auto & [name, value] : statuses) {
+        if (text == name) {
+            status = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Отрезает от line поле до табуляции
+bool TakeField(string_view& line, string_view& field) {
+    const size_t tab = line.find('\t');
+    if (tab == string_view::npos) {
+        return false;
+    }
+    field = line.substr(0, tab);
+    line.remove_prefix(tab + 1);
+    return true;
+}
+
+bool ParseDocument(string_view line, NewDocument& document) {
+    string_view id;
+    string_view status;
+    string_view ratings;
+    if (!TakeField(line, id) || !TakeField(line, status) || !TakeField(line, ratings)
+        || !ParseInt(id, document.id) || !ParseStatus(status, document.status)) {
+        return false;
+    }
+    document.ratings.clear();
+    while (!ratings.empty()) {
+        const size_t space = ratings.find(' ');
+        const string_view rating = ratings.substr(0, space);
+        if (!rating.empty()) {
+            document.ratings.push_back(0);
+            if (!ParseInt(rating, document.ratings.back())) {
+                return false;
+            }
+        }
+        ratings.remove_prefix(space == string_view::npos ? ratings.size() : space + 1);
+    }
+    document.text = line;
+    return true;
+}
+
+}
+
+DocumentReader::DocumentReader(istream& input, size_t chunk_size)
+    : input_(input)
+    , chunk_size_(max<size_t>(chunk_size, 1))
+{}
+
+bool DocumentReader::ReadChunk(DocumentChunk& chunk) {
+    if (error_) {
+        rethrow_exception(exchange(error_, nullptr));
+    }
+    auto buffer = make_shared<vector<char>>();
+    buffer->reserve(carry_.size() + chunk_size_);
+    buffer->insert(buffer->end(), carry_.begin(), carry_.end());
+    carry_.clear();
+    // блоки дочитываются, пока в буфере нет ни одной целой строки
+    size_t lines_end = 0;
+    bool at_end = false;
+    while (lines_end == 0 && !at_end) {
+        const size_t size = buffer->size();
+        buffer->resize(size + chunk_size_);
+        input_.read(buffer->data() + size, static_cast<streamsize>(chunk_size_));
+        if (input_.bad()) {
+            throw runtime_error("LoadDocuments: read error"s);
+        }
+        buffer->resize(size + static_cast<size_t>(input_.gcount()));
+        at_end = input_.eof();
+        const auto last_newline = find(buffer->rbegin(), buffer->rend(), '\n');
+        lines_end = at_end ? buffer->size() : static_cast<size_t>(buffer->rend() - last_newline);
+    }
+    if (buffer->empty()) {
+        return false;
+    }
+    carry_.assign(buffer->begin() + static_cast<ptrdiff_t>(lines_end), buffer->end());
+    buffer->resize(lines_end);
+
+    chunk.documents.clear();
+    try {
+        ParseLines(buffer->data(), buffer->data() + buffer->size(), chunk.documents);
+    } catch (...) {
+        error_ = current_exception();
+    }
+    chunk.buffer = move(buffer);
+    return true;
+}
+
+void DocumentReader::ParseLines(const char* first, const char* last, vector<NewDocument>& documents) {
+    while (first != last) {
+        const char* newline = static_cast<const char*>(memchr(first, '\n', static_cast<size_t>(last - first)));
+        const char* line_end = newline != nullptr ? newline : last;
+        string_view line(first, static_cast<size_t>(line_end - first));
+        first = newline != nullptr ? newline + 1 : last;
+        ++line_number_;
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (line.empty()) {
+            continue;
+        }
+        NewDocument document;
+        if (!ParseDocument(line, document)) {
+            throw invalid_argument("LoadDocuments: bad document at line "s + to_string(line_number_));
+        }
+        documents.push_back(move(document));
+    }
+}
+
+size_t LoadDocuments(istream& input, SearchServer& server, const LoadOptions& options) {
+    BoundedQueue<DocumentChunk> queue(options.queue_capacity);
+    exception_ptr read_error;
+    thread reader_thread([&input, &options, &queue, &read_error] {
+        try {
+            DocumentReader reader(input, options.chunk_size);
+            DocumentChunk chunk;
+            while (reader.ReadChunk(chunk)) {
+                if (!queue.Push(move(chunk))) {
+                    break;
+                }
+                chunk = {};
+            }
+        } catch (...) {
+            read_error = current_exception();
+        }
+        queue.Close();
+    });
+
+    size_t document_count = 0;
+    try {
+        while (auto chunk = queue.Pop()) {
+            server.AddDocuments(chunk->documents);
+            document_count += chunk->documents.size();
+        }
+    } catch (...) {
+        // чтение останавливается: Push в закрытую очередь возвращает false
+        queue.Close();
+        reader_thread.join();
+        throw;
+    }
+    reader_thread.join();
+    if (read_error) {
+        rethrow_exception(read_error);
+    }
+    return document_count;
+}
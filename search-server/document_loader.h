@@ -0,0 +1,55 @@
+#pragma once
+
+#include "search_server.h"
+
+#include <cstddef>
+#include <exception>
+#include <istream>
+#include <memory>
+#include <vector>
+
+// Загрузка документов из потока, по строке на документ, поля через табуляцию:
+//   id <TAB> статус <TAB> рейтинги через пробел <TAB> текст
+// Статус - имя из DocumentStatus (ACTUAL, IRRELEVANT, BANNED, REMOVED).
+// Пустые строки пропускаются, \r перед \n отбрасывается.
+
+// Порция разобранных документов: тексты указывают в buffer
+struct DocumentChunk {
+    std::shared_ptr<std::vector<char>> buffer;
+    std::vector<NewDocument> documents;
+};
+
+// Читает поток большими блоками и разбирает целые строки блока без
+// копирования текстов. Строка, не поместившаяся в блок, переносится в следующий.
+class DocumentReader {
+public:
+    DocumentReader(std::istream& input, size_t chunk_size);
+
+    // Следующая порция; false, когда поток прочитан. Ошибка формата -
+    // invalid_argument с номером строки.
+    bool ReadChunk(DocumentChunk& chunk);
+
+private:
+    std::istream& input_;
+    size_t chunk_size_;
+    // начало строки, не поместившейся в прошлый блок
+    std::vector<char> carry_;
+    size_t line_number_ = 0;
+    // ошибка формата, отложенная до следующего вызова, чтобы сначала
+    // отдать документы до ошибочной строки
+    std::exception_ptr error_;
+
+    void ParseLines(const char* first, const char* last, std::vector<NewDocument>& documents);
+};
+
+struct LoadOptions {
+    size_t chunk_size = 4 * 1024 * 1024;
+    // прочитанных, но ещё не добавленных порций не больше этого
+    size_t queue_capacity = 4;
+};
+
+// Добавляет в server документы из input и возвращает их число. Чтение и разбор
+// идут в отдельном потоке параллельно с добавлением порций через AddDocuments.
+// При ошибке документы до ошибочного остаются добавленными, как при добавлении
+// по одному, и исключение пробрасывается.
+size_t LoadDocuments(std::istream& input, SearchServer& server, const LoadOptions& options = {});
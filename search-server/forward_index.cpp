@@ -0,0 +1,120 @@
+#include "forward_index.h"
+
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+void ForwardIndex::AddDocument(size_t term_count) {
+    documents_.push_back({terms_.size(), static_cast<uint32_t>(term_count), 0});
+    terms_.resize(terms_.size() + term_count);
+}
+
+void ForwardIndex::UpdateFingerprint(DocumentOrdinal ordinal) {
+    uint64_t fingerprint = 0;
+    for (const DocumentTerm & term : GetTerms(ordinal)) {
+        fingerprint += HashTermId(term.term_id);
+    }
+    documents_[ordinal].fingerprint = fingerprint;
+}
+
+void ForwardIndex::RemoveDocument(DocumentOrdinal ordinal) {
+    Range & range = documents_[ordinal];
+    removed_term_count_ += range.count;
+    range = {};
+    if (removed_term_count_ * 2 > terms_.size()) {
+        Compact();
+    }
+}
+
+void ForwardIndex::RemoveOrdinals(const vector<DocumentOrdinal>& ordinals) {
+    auto removed = ordinals.begin();
+    size_t size = ordinals.front();
+    for (size_t ordinal = ordinals.front(); ordinal < documents_.size(); ++ordinal) {
+        if (removed != ordinals.end() && *removed == ordinal) {
+            ++removed;
+        } else {
+            documents_[size++] = documents_[ordinal];
+        }
+    }
+    documents_.resize(size);
+}
+
+void ForwardIndex::Compact() {
+    vector<DocumentTerm> terms;
+    terms.reserve(terms_.size() - removed_term_count_);
+    for (Range & range : documents_) {
+        const auto first = terms_.begin() + static_cast<ptrdiff_t>(range.offset);
+        range.offset = terms.size();
+        terms.insert(terms.end(), first, first + range.count);
+    }
+    terms_ = move(terms);
+    removed_term_count_ = 0;
+}
+
+void ForwardIndex::Save(SnapshotWriter& writer) const {
+    // смещения считаются без слов удалённых документов, которые не записываются
+    vector<uint64_t> offsets{0};
+    offsets.reserve(documents_.size() + 1);
+    for (const Range & range : documents_) {
+        offsets.push_back(offsets.back() + range.count);
+    }
+    writer.BeginSection(SnapshotSectionKind::FORWARD_OFFSETS);
+    writer.Write(offsets);
+    writer.EndSection();
+    writer.BeginSection(SnapshotSectionKind::FORWARD_TERMS);
+    for (DocumentOrdinal ordinal = 0; ordinal < documents_.size(); ++ordinal) {
+        for (const DocumentTerm & term : GetTerms(ordinal)) {
+            writer.Write(&term.term_id, 1);
+        }
+    }
+    writer.EndSection();
+    writer.BeginSection(SnapshotSectionKind::FORWARD_TERM_FREQS);
+    for (DocumentOrdinal ordinal = 0; ordinal < documents_.size(); ++ordinal) {
+        for (const DocumentTerm & term : GetTerms(ordinal)) {
+            writer.Write(&term.term_freq, 1);
+        }
+    }
+    writer.EndSection();
+}
+
+ForwardIndex ForwardIndex::Open(const SnapshotReader& reader, size_t document_count, size_t term_count) {
+    auto check = [](bool condition) {
+        if (!condition) {
+            throw runtime_error("OpenSnapshot: inconsistent snapshot"s);
+        }
+    };
+    size_t count;
+    const auto* offsets = reader.GetArray<uint64_t>(SnapshotSectionKind::FORWARD_OFFSETS, count);
+    check(count == document_count + 1 && offsets[0] == 0);
+    size_t word_count;
+    const auto* term_ids = reader.GetArray<TermId>(SnapshotSectionKind::FORWARD_TERMS, word_count);
+    const auto* term_freqs = reader.GetArray<double>(SnapshotSectionKind::FORWARD_TERM_FREQS, count);
+    check(count == word_count && offsets[document_count] == word_count);
+
+    ForwardIndex index;
+    index.documents_.reserve(document_count);
+    for (size_t ordinal = 0; ordinal < document_count; ++ordinal) {
+        check(offsets[ordinal] <= offsets[ordinal + 1] && offsets[ordinal + 1] - offsets[ordinal] <= UINT32_MAX);
+        index.documents_.push_back({offsets[ordinal], static_cast<uint32_t>(offsets[ordinal + 1] - offsets[ordinal]), 0});
+    }
+    index.terms_.resize(word_count);
+    for (size_t i = 0; i < word_count; ++i) {
+        check(term_ids[i] < term_count);
+        index.terms_[i] = {term_ids[i], term_freqs[i]};
+    }
+    // снимки, записанные до прямого индекса, хранят слова документа по алфавиту
+    for (const Range & range : index.documents_) {
+        const auto first = index.terms_.begin() + static_cast<ptrdiff_t>(range.offset);
+        const auto by_term_id = [](const DocumentTerm& lhs, const DocumentTerm& rhs) {
+            return lhs.term_id < rhs.term_id;
+        };
+        if (!is_sorted(first, first + range.count, by_term_id)) {
+            sort(first, first + range.count, by_term_id);
+        }
+    }
+    for (DocumentOrdinal ordinal = 0; ordinal < document_count; ++ordinal) {
+        index.UpdateFingerprint(ordinal);
+    }
+    return index;
+}
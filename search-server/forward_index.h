@@ -0,0 +1,135 @@
+#pragma once
+
+#include "posting_list.h"
+#include "snapshot.h"
+#include "term_dictionary.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+// Перемешивает биты TermId; разные seed дают независимые хеши
+inline uint64_t HashTermId(TermId term_id, uint64_t seed = 0) {
+    uint64_t value = (term_id + seed) * 0x9E3779B97F4A7C15ull;
+    value ^= value >> 32;
+    value *= 0xD6E8FEB86659FD93ull;
+    value ^= value >> 32;
+    return value;
+}
+
+// Слово документа и его TF
+struct DocumentTerm {
+    TermId term_id;
+    double term_freq;
+};
+
+// Слова одного документа по возрастанию TermId. Указывает в ForwardIndex
+// и действительно до его следующего изменения.
+class DocumentTermsView {
+public:
+    using const_iterator = const DocumentTerm*;
+
+    DocumentTermsView() = default;
+
+    DocumentTermsView(const DocumentTerm* data, size_t size)
+        : data_(data)
+        , size_(size)
+    {}
+
+    const_iterator begin() const {
+        return data_;
+    }
+
+    const_iterator end() const {
+        return data_ + size_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    const DocumentTerm& operator[](size_t index) const {
+        return data_[index];
+    }
+
+    bool Contains(TermId term_id) const {
+        return Find(term_id) != nullptr;
+    }
+
+    // nullptr, если слова в документе нет
+    const DocumentTerm* Find(TermId term_id) const {
+        const auto it = std::lower_bound(begin(), end(), term_id, [](const DocumentTerm& term, TermId id) {
+            return term.term_id < id;
+        });
+        return it != end() && it->term_id == term_id ? it : nullptr;
+    }
+
+private:
+    const DocumentTerm* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Прямой индекс: слова всех документов лежат подряд в одном массиве, документ
+// хранит только смещение и число своих слов. Слова удалённых документов
+// остаются в массиве, пока их не станет больше половины, и тогда массив
+// переписывается без них. Для каждого документа хранится 64-битный отпечаток
+// множества его слов - сумма HashTermId по словам, не зависящая от их порядка.
+class ForwardIndex {
+public:
+    // Добавляет документ со следующим номером и term_count словами
+    void AddDocument(size_t term_count);
+
+    // Слова документа для заполнения по возрастанию TermId
+    DocumentTerm* GetMutableTerms(DocumentOrdinal ordinal) {
+        return terms_.data() + documents_[ordinal].offset;
+    }
+
+    DocumentTermsView GetTerms(DocumentOrdinal ordinal) const {
+        const Range & range = documents_[ordinal];
+        return {terms_.data() + range.offset, range.count};
+    }
+
+    // Пересчитывает отпечаток после заполнения слов документа
+    void UpdateFingerprint(DocumentOrdinal ordinal);
+
+    uint64_t GetFingerprint(DocumentOrdinal ordinal) const {
+        return documents_[ordinal].fingerprint;
+    }
+
+    void RemoveDocument(DocumentOrdinal ordinal);
+
+    // Удаляет записи удалённых документов с номерами из ordinals (отсортированы),
+    // номера следующих документов уменьшаются
+    void RemoveOrdinals(const std::vector<DocumentOrdinal>& ordinals);
+
+    size_t GetDocumentCount() const {
+        return documents_.size();
+    }
+
+    // Секции FORWARD_OFFSETS, FORWARD_TERMS и FORWARD_TERM_FREQS снимка
+    void Save(SnapshotWriter& writer) const;
+
+    // Прямой индекс из секций снимка; бросает runtime_error, если они не
+    // согласованы с числом документов и слов
+    static ForwardIndex Open(const SnapshotReader& reader, size_t document_count, size_t term_count);
+
+private:
+    struct Range {
+        uint64_t offset = 0;
+        uint32_t count = 0;
+        uint64_t fingerprint = 0;
+    };
+
+    std::vector<DocumentTerm> terms_;
+    std::vector<Range> documents_;
+    // слова удалённых документов, ещё занимающие место в terms_
+    size_t removed_term_count_ = 0;
+
+    void Compact();
+};
@@ -0,0 +1,318 @@
+#include "index_segment.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+void WriteVarint(vector<uint8_t>& bytes, uint32_t value) {
+    while (value >= 0x80) {
+        bytes.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back(static_cast<uint8_t>(value));
+}
+
+const uint8_t* ReadVarint(const uint8_t* bytes, uint32_t& value) {
+    value = 0;
+    for (int shift = 0;; shift += 7) {
+        const uint8_t byte = *bytes++;
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if (byte < 0x80) {
+            return bytes;
+        }
+    }
+}
+
+}
+
+shared_ptr<const IndexSegment> IndexSegment::Build(const vector<PostingList>& posting_lists,
+                                                   const vector<TermId>& terms,
+                                                   DocumentOrdinal first, DocumentOrdinal last,
+                                                   const vector<uint32_t>& document_lengths,
+                                                   const vector<DocumentOrdinal>& removed_ordinals) {
+    auto segment = make_shared<IndexSegment>();
+    segment->document_count_ = last - first - removed_ordinals.size();
+    segment->document_length_storage_.reserve(segment->document_count_);
+    auto removed = removed_ordinals.begin();
+    for (DocumentOrdinal ordinal = first; ordinal < last; ++ordinal) {
+        if (removed != removed_ordinals.end() && *removed == ordinal) {
+            ++removed;
+        } else {
+            segment->document_length_storage_.push_back(document_lengths[ordinal - first]);
+        }
+    }
+    segment->term_storage_.reserve(terms.size());
+    for (const TermId term_id : terms) {
+        segment->BeginTerm(term_id);
+        segment->AddPostings(PostingCursor(posting_lists[term_id]), first, removed_ordinals);
+        segment->EndTerm();
+    }
+    segment->UseStorage();
+    return segment;
+}
+
+shared_ptr<const IndexSegment> IndexSegment::Merge(const vector<shared_ptr<const IndexSegment>>& segments,
+                                                   const vector<DocumentOrdinal>& removed_ordinals) {
+    auto merged = make_shared<IndexSegment>();
+    // номера документов в объединяемых сегментах, идущих подряд
+    vector<DocumentOrdinal> first_ordinals;
+    DocumentOrdinal ordinal = 0;
+    auto removed = removed_ordinals.begin();
+    for (const auto & segment : segments) {
+        first_ordinals.push_back(ordinal);
+        for (size_t i = 0; i < segment->document_count_; ++i, ++ordinal) {
+            if (removed != removed_ordinals.end() && *removed == ordinal) {
+                ++removed;
+            } else {
+                merged->document_length_storage_.push_back(segment->document_lengths_[i]);
+            }
+        }
+    }
+    merged->document_count_ = merged->document_length_storage_.size();
+
+    vector<TermId> terms;
+    for (const auto & segment : segments) {
+        for (size_t i = 0; i < segment->term_count_; ++i) {
+            terms.push_back(segment->terms_[i].term_id);
+        }
+    }
+    sort(terms.begin(), terms.end());
+    terms.erase(unique(terms.begin(), terms.end()), terms.end());
+    merged->term_storage_.reserve(terms.size());
+
+    for (const TermId term_id : terms) {
+        merged->BeginTerm(term_id);
+        for (size_t i = 0; i < segments.size(); ++i) {
+            if (const TermPostings* term = segments[i]->FindTerm(term_id)) {
+                merged->AddPostings(SegmentCursor(*segments[i], *term, first_ordinals[i]), 0, removed_ordinals);
+            }
+        }
+        merged->EndTerm();
+    }
+    merged->term_storage_.shrink_to_fit();
+    merged->block_storage_.shrink_to_fit();
+    merged->posting_byte_storage_.shrink_to_fit();
+    merged->UseStorage();
+    return merged;
+}
+
+void IndexSegment::Save(SnapshotWriter& writer) const {
+    const SavedHeader header{document_count_, term_count_, block_count_, posting_byte_count_};
+    writer.BeginSection(SnapshotSectionKind::SEGMENT);
+    writer.Write(&header, 1);
+    writer.Write(terms_, term_count_);
+    writer.Write(blocks_, block_count_);
+    writer.Write(document_lengths_, document_count_);
+    writer.Write(posting_bytes_, posting_byte_count_);
+    writer.EndSection();
+}
+
+shared_ptr<const IndexSegment> IndexSegment::Open(SnapshotReader::Bytes section, shared_ptr<const MappedFile> file) {
+    SavedHeader header;
+    if (section.size < sizeof(header)) {
+        throw runtime_error("OpenSnapshot: bad segment"s);
+    }
+    memcpy(&header, section.data, sizeof(header));
+    const uint64_t size = sizeof(header) + header.term_count * sizeof(TermPostings)
+        + header.block_count * sizeof(Block) + header.document_count * sizeof(uint32_t) + header.posting_byte_count;
+    if (header.document_count >= NO_DOCUMENT || size != section.size) {
+        throw runtime_error("OpenSnapshot: bad segment"s);
+    }
+
+    auto segment = make_shared<IndexSegment>();
+    segment->document_count_ = header.document_count;
+    const uint8_t* data = section.data + sizeof(header);
+    segment->terms_ = reinterpret_cast<const TermPostings*>(data);
+    segment->term_count_ = header.term_count;
+    data += header.term_count * sizeof(TermPostings);
+    segment->blocks_ = reinterpret_cast<const Block*>(data);
+    segment->block_count_ = header.block_count;
+    data += header.block_count * sizeof(Block);
+    segment->document_lengths_ = reinterpret_cast<const uint32_t*>(data);
+    data += header.document_count * sizeof(uint32_t);
+    segment->posting_bytes_ = data;
+    segment->posting_byte_count_ = header.posting_byte_count;
+    segment->file_ = move(file);
+
+    // курсоры не проверяют границы, поэтому их проверяем здесь
+    for (size_t i = 0; i < segment->term_count_; ++i) {
+        const TermPostings & term = segment->terms_[i];
+        const uint64_t block_count = (term.posting_count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        if ((i > 0 && segment->terms_[i - 1].term_id >= term.term_id)
+            || term.first_block + block_count > segment->block_count_) {
+            throw runtime_error("OpenSnapshot: bad segment"s);
+        }
+    }
+    for (size_t i = 0; i < segment->block_count_; ++i) {
+        if (segment->blocks_[i].byte_offset >= segment->posting_byte_count_
+            || segment->blocks_[i].last_ordinal >= segment->document_count_) {
+            throw runtime_error("OpenSnapshot: bad segment"s);
+        }
+    }
+    return segment;
+}
+
+void IndexSegment::UseStorage() {
+    terms_ = term_storage_.data();
+    term_count_ = term_storage_.size();
+    blocks_ = block_storage_.data();
+    block_count_ = block_storage_.size();
+    posting_bytes_ = posting_byte_storage_.data();
+    posting_byte_count_ = posting_byte_storage_.size();
+    document_lengths_ = document_length_storage_.data();
+}
+
+template <typename Cursor>
+void IndexSegment::AddPostings(Cursor cursor, DocumentOrdinal first, const vector<DocumentOrdinal>& removed_ordinals) {
+    auto removed = removed_ordinals.begin();
+    for (; cursor.GetOrdinal() != NO_DOCUMENT; cursor.Next()) {
+        const DocumentOrdinal ordinal = cursor.GetOrdinal();
+        removed = lower_bound(removed, removed_ordinals.end(), ordinal);
+        if (removed == removed_ordinals.end() || *removed != ordinal) {
+            const auto removed_before = static_cast<DocumentOrdinal>(removed - removed_ordinals.begin());
+            AddPosting(ordinal - first - removed_before, cursor.GetTermCount(), cursor.GetTermFreq());
+        }
+    }
+}
+
+const IndexSegment::TermPostings* IndexSegment::FindTerm(TermId term_id) const {
+    const TermPostings* terms_end = terms_ + term_count_;
+    const auto it = lower_bound(terms_, terms_end, term_id, [](const TermPostings & term, TermId value) {
+        return term.term_id < value;
+    });
+    return it != terms_end && it->term_id == term_id ? it : nullptr;
+}
+
+void IndexSegment::BeginTerm(TermId term_id) {
+    term_storage_.push_back({term_id, static_cast<uint32_t>(block_storage_.size()), 0, 0.0});
+}
+
+void IndexSegment::AddPosting(DocumentOrdinal ordinal, uint32_t term_count, double term_freq) {
+    TermPostings & term = term_storage_.back();
+    DocumentOrdinal previous;
+    if (term.posting_count % BLOCK_SIZE == 0) {
+        previous = term.posting_count == 0 ? 0 : block_storage_.back().last_ordinal;
+        block_storage_.push_back({ordinal, static_cast<uint32_t>(posting_byte_storage_.size()), term_freq});
+    } else {
+        Block & block = block_storage_.back();
+        previous = block.last_ordinal;
+        block.last_ordinal = ordinal;
+        block.max_term_freq = max(block.max_term_freq, term_freq);
+    }
+    WriteVarint(posting_byte_storage_, ordinal - previous);
+    WriteVarint(posting_byte_storage_, term_count);
+    term.max_term_freq = max(term.max_term_freq, term_freq);
+    ++term.posting_count;
+}
+
+void IndexSegment::EndTerm() {
+    if (term_storage_.back().posting_count == 0) {
+        term_storage_.pop_back();
+    }
+}
+
+SegmentCursor::SegmentCursor(const IndexSegment& segment, const IndexSegment::TermPostings& term,
+                             DocumentOrdinal first_ordinal)
+    : segment_(&segment)
+    , blocks_(segment.GetBlocks() + term.first_block)
+    , posting_bytes_(segment.GetPostingBytes())
+    , segment_first_ordinal_(first_ordinal)
+    , segment_last_ordinal_(static_cast<DocumentOrdinal>(first_ordinal + segment.GetDocumentCount()))
+    , max_term_freq_(term.max_term_freq)
+    , size_(term.posting_count)
+    , block_count_((term.posting_count + IndexSegment::BLOCK_SIZE - 1) / IndexSegment::BLOCK_SIZE)
+{
+    if (size_ > 0) {
+        DecodeBlock(0);
+    }
+}
+
+void SegmentCursor::DecodeBlock(size_t block) {
+    const size_t count = min(IndexSegment::BLOCK_SIZE, size_ - block * IndexSegment::BLOCK_SIZE);
+    const uint8_t* bytes = posting_bytes_ + blocks_[block].byte_offset;
+    DocumentOrdinal ordinal = block == 0 ? 0 : blocks_[block - 1].last_ordinal;
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t delta;
+        bytes = ReadVarint(bytes, delta);
+        ordinal += delta;
+        decoded_[i] = ordinal;
+        bytes = ReadVarint(bytes, decoded_counts_[i]);
+    }
+}
+
+void SegmentCursor::SkipTo(DocumentOrdinal target) {
+    if (pos_ >= size_ || GetOrdinal() >= target) {
+        return;
+    }
+    target = ToSegmentOrdinal(target);
+    size_t block = pos_ / IndexSegment::BLOCK_SIZE;
+    if (blocks_[block].last_ordinal < target) {
+        // первый из следующих блоков, последний номер которого не меньше target
+        const auto it = lower_bound(blocks_ + block + 1, blocks_ + block_count_, target,
+            [](const IndexSegment::Block & value, DocumentOrdinal ordinal) {
+                return value.last_ordinal < ordinal;
+            });
+        block = it - blocks_;
+        if (block == block_count_) {
+            pos_ = size_;
+            return;
+        }
+        DecodeBlock(block);
+        pos_ = block * IndexSegment::BLOCK_SIZE;
+    }
+    const size_t count = min(IndexSegment::BLOCK_SIZE, size_ - block * IndexSegment::BLOCK_SIZE);
+    const size_t offset = pos_ - block * IndexSegment::BLOCK_SIZE;
+    pos_ = block * IndexSegment::BLOCK_SIZE + (lower_bound(decoded_ + offset, decoded_ + count, target) - decoded_);
+}
+
+double SegmentCursor::GetBlockMaxTermFreq(DocumentOrdinal target, DocumentOrdinal& block_last) const {
+    const auto it = lower_bound(blocks_ + min(pos_ / IndexSegment::BLOCK_SIZE, block_count_), blocks_ + block_count_,
+                                ToSegmentOrdinal(target),
+        [](const IndexSegment::Block & value, DocumentOrdinal ordinal) {
+            return value.last_ordinal < ordinal;
+        });
+    if (it == blocks_ + block_count_) {
+        block_last = NO_DOCUMENT;
+        return 0.0;
+    }
+    block_last = segment_first_ordinal_ + it->last_ordinal;
+    return it->max_term_freq;
+}
+
+TermCursor::TermCursor(vector<SegmentCursor> segment_cursors, const PostingList& buffer_posting_list)
+    : segment_cursors_(move(segment_cursors))
+    , buffer_cursor_(buffer_posting_list)
+    , max_term_freq_(buffer_posting_list.GetMaxTermFreq())
+{
+    for (const SegmentCursor & cursor : segment_cursors_) {
+        max_term_freq_ = max(max_term_freq_, cursor.GetMaxTermFreq());
+    }
+}
+
+void TermCursor::SkipTo(DocumentOrdinal target) {
+    for (; part_ < segment_cursors_.size(); ++part_) {
+        SegmentCursor & cursor = segment_cursors_[part_];
+        if (cursor.GetSegmentLastOrdinal() <= target) {
+            continue;
+        }
+        cursor.SkipTo(target);
+        if (cursor.GetOrdinal() != NO_DOCUMENT) {
+            return;
+        }
+    }
+    buffer_cursor_.SkipTo(target);
+}
+
+double TermCursor::GetBlockMaxTermFreq(DocumentOrdinal target, DocumentOrdinal& block_last) const {
+    for (size_t part = part_; part < segment_cursors_.size(); ++part) {
+        const double max_term_freq = segment_cursors_[part].GetBlockMaxTermFreq(target, block_last);
+        if (block_last != NO_DOCUMENT) {
+            return max_term_freq;
+        }
+    }
+    return buffer_cursor_.GetBlockMaxTermFreq(target, block_last);
+}
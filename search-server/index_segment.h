@@ -0,0 +1,269 @@
+#pragma once
+
+#include "posting_list.h"
+#include "snapshot.h"
+#include "term_dictionary.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Неизменяемый сегмент инвертированного индекса: списки вхождений документов
+// с номерами из [0, GetDocumentCount()) относительно начала сегмента. Номер
+// первого документа сегмента знает индекс, поэтому при перенумерации документов
+// сегменты не переписываются. Вхождения хранятся блоками по BLOCK_SIZE в виде
+// пар чисел переменной длины: разность номеров и число повторений слова
+// в документе; для каждого блока записаны последний номер, смещение
+// и максимальная TF, поэтому курсор пропускает блоки, не распаковывая их.
+// TF вхождения курсор считает по числу повторений и длине документа, она
+// совпадает с TF из PostingList до бита. Сегмент, открытый из снимка, читает
+// эти массивы прямо из отображённого файла.
+class IndexSegment {
+public:
+    static constexpr size_t BLOCK_SIZE = PostingList::BLOCK_SIZE;
+
+    struct Block {
+        DocumentOrdinal last_ordinal;
+        uint32_t byte_offset;
+        double max_term_freq;
+    };
+
+    struct TermPostings {
+        TermId term_id;
+        uint32_t first_block;
+        uint32_t posting_count;
+        double max_term_freq;
+    };
+
+    // Сегмент из списков вхождений буфера с номерами из [first, last).
+    // terms - отсортированные id слов, списки которых непусты, document_lengths -
+    // число слов документов диапазона. Документы из removed_ordinals
+    // (отсортированы) отбрасываются, остальные нумеруются подряд с нуля.
+    static std::shared_ptr<const IndexSegment> Build(const std::vector<PostingList>& posting_lists,
+                                                     const std::vector<TermId>& terms,
+                                                     DocumentOrdinal first, DocumentOrdinal last,
+                                                     const std::vector<uint32_t>& document_lengths,
+                                                     const std::vector<DocumentOrdinal>& removed_ordinals);
+
+    // Объединяет соседние сегменты, упорядоченные по номерам документов.
+    // Документы из removed_ordinals (отсортированы, номера относительно начала
+    // первого сегмента) отбрасываются, остальные нумеруются подряд с нуля;
+    // слова без оставшихся вхождений в сегмент не попадают.
+    static std::shared_ptr<const IndexSegment> Merge(const std::vector<std::shared_ptr<const IndexSegment>>& segments,
+                                                     const std::vector<DocumentOrdinal>& removed_ordinals);
+
+    // Записывает сегмент секцией SEGMENT
+    void Save(SnapshotWriter& writer) const;
+
+    // Сегмент поверх секции снимка; файл удерживается, пока жив сегмент
+    static std::shared_ptr<const IndexSegment> Open(SnapshotReader::Bytes section,
+                                                    std::shared_ptr<const MappedFile> file);
+
+    // Число документов сегмента, включая удалённые после его построения
+    size_t GetDocumentCount() const {
+        return document_count_;
+    }
+
+    // nullptr, если слова в сегменте нет
+    const TermPostings* FindTerm(TermId term_id) const;
+
+    // Слова сегмента по возрастанию id
+    const TermPostings* GetTerms() const {
+        return terms_;
+    }
+
+    size_t GetTermCount() const {
+        return term_count_;
+    }
+
+    const Block* GetBlocks() const {
+        return blocks_;
+    }
+
+    const uint8_t* GetPostingBytes() const {
+        return posting_bytes_;
+    }
+
+    // число слов документа сегмента
+    uint32_t GetDocumentLength(DocumentOrdinal ordinal) const {
+        return document_lengths_[ordinal];
+    }
+
+private:
+    // заголовок секции снимка, за ним массивы terms, blocks, document_lengths
+    // и posting_bytes
+    struct SavedHeader {
+        uint64_t document_count;
+        uint64_t term_count;
+        uint64_t block_count;
+        uint64_t posting_byte_count;
+    };
+
+    size_t document_count_ = 0;
+    // массивы сегмента: указывают в векторы построенного сегмента
+    // или в отображённый файл снимка
+    const TermPostings* terms_ = nullptr;
+    size_t term_count_ = 0;
+    const Block* blocks_ = nullptr;
+    size_t block_count_ = 0;
+    const uint8_t* posting_bytes_ = nullptr;
+    size_t posting_byte_count_ = 0;
+    const uint32_t* document_lengths_ = nullptr;
+
+    // данные построенного сегмента
+    std::vector<TermPostings> term_storage_;
+    std::vector<Block> block_storage_;
+    std::vector<uint8_t> posting_byte_storage_;
+    std::vector<uint32_t> document_length_storage_;
+    std::shared_ptr<const MappedFile> file_;
+
+    // Направляет указатели массивов на собственные векторы
+    void UseStorage();
+
+    void BeginTerm(TermId term_id);
+    void AddPosting(DocumentOrdinal ordinal, uint32_t term_count, double term_freq);
+    void EndTerm();
+
+    // Добавляет вхождения курсора, пропуская удалённые документы; номер
+    // оставшегося уменьшается на first и число удалённых перед ним
+    template <typename Cursor>
+    void AddPostings(Cursor cursor, DocumentOrdinal first, const std::vector<DocumentOrdinal>& removed_ordinals);
+};
+
+// Курсор по вхождениям одного слова в сегмент, распаковывает по блоку за раз.
+// Номера курсора - номера в индексе: номер в сегменте плюс first_ordinal.
+class SegmentCursor {
+public:
+    SegmentCursor(const IndexSegment& segment, const IndexSegment::TermPostings& term, DocumentOrdinal first_ordinal);
+
+    // NO_DOCUMENT, когда список пройден
+    DocumentOrdinal GetOrdinal() const {
+        return pos_ < size_ ? segment_first_ordinal_ + decoded_[pos_ % IndexSegment::BLOCK_SIZE] : NO_DOCUMENT;
+    }
+
+    uint32_t GetTermCount() const {
+        return decoded_counts_[pos_ % IndexSegment::BLOCK_SIZE];
+    }
+
+    double GetTermFreq() const {
+        return ComputeTermFreq(GetTermCount(), segment_->GetDocumentLength(decoded_[pos_ % IndexSegment::BLOCK_SIZE]));
+    }
+
+    void Next() {
+        ++pos_;
+        if (pos_ < size_ && pos_ % IndexSegment::BLOCK_SIZE == 0) {
+            DecodeBlock(pos_ / IndexSegment::BLOCK_SIZE);
+        }
+    }
+
+    // Переходит к первому документу с номером не меньше target
+    void SkipTo(DocumentOrdinal target);
+
+    // То же, что PostingCursor::GetBlockMaxTermFreq
+    double GetBlockMaxTermFreq(DocumentOrdinal target, DocumentOrdinal& block_last) const;
+
+    // Вызывает function(ordinal, term_freq) для вхождений с номером меньше last,
+    // оставляя курсор на первом непройденном
+    template <typename Function>
+    void ForEachBefore(DocumentOrdinal last, Function& function) {
+        while (pos_ < size_) {
+            const size_t block_end = std::min(size_, (pos_ / IndexSegment::BLOCK_SIZE + 1) * IndexSegment::BLOCK_SIZE);
+            for (; pos_ < block_end; ++pos_) {
+                const DocumentOrdinal segment_ordinal = decoded_[pos_ % IndexSegment::BLOCK_SIZE];
+                const DocumentOrdinal ordinal = segment_first_ordinal_ + segment_ordinal;
+                if (ordinal >= last) {
+                    return;
+                }
+                function(ordinal, ComputeTermFreq(decoded_counts_[pos_ % IndexSegment::BLOCK_SIZE],
+                                                  segment_->GetDocumentLength(segment_ordinal)));
+            }
+            if (pos_ < size_) {
+                DecodeBlock(pos_ / IndexSegment::BLOCK_SIZE);
+            }
+        }
+    }
+
+    double GetMaxTermFreq() const {
+        return max_term_freq_;
+    }
+
+    DocumentOrdinal GetSegmentLastOrdinal() const {
+        return segment_last_ordinal_;
+    }
+
+private:
+    const IndexSegment* segment_;
+    const IndexSegment::Block* blocks_;
+    const uint8_t* posting_bytes_;
+    DocumentOrdinal segment_first_ordinal_;
+    DocumentOrdinal segment_last_ordinal_;
+    double max_term_freq_;
+    size_t size_;
+    size_t block_count_;
+    size_t pos_ = 0;
+    DocumentOrdinal decoded_[IndexSegment::BLOCK_SIZE];
+    uint32_t decoded_counts_[IndexSegment::BLOCK_SIZE];
+
+    void DecodeBlock(size_t block);
+
+    // Номер в сегменте первого документа, номер которого в индексе не меньше target
+    DocumentOrdinal ToSegmentOrdinal(DocumentOrdinal target) const {
+        return target > segment_first_ordinal_ ? target - segment_first_ordinal_ : 0;
+    }
+};
+
+// Курсор по вхождениям слова во все сегменты и буфер индекса. Части идут
+// по возрастанию номеров документов, поэтому обход просто переходит от одной
+// к следующей.
+class TermCursor {
+public:
+    TermCursor(std::vector<SegmentCursor> segment_cursors, const PostingList& buffer_posting_list);
+
+    DocumentOrdinal GetOrdinal() const {
+        return part_ < segment_cursors_.size() ? segment_cursors_[part_].GetOrdinal() : buffer_cursor_.GetOrdinal();
+    }
+
+    double GetTermFreq() const {
+        return part_ < segment_cursors_.size() ? segment_cursors_[part_].GetTermFreq() : buffer_cursor_.GetTermFreq();
+    }
+
+    void Next() {
+        if (part_ < segment_cursors_.size()) {
+            segment_cursors_[part_].Next();
+            if (segment_cursors_[part_].GetOrdinal() == NO_DOCUMENT) {
+                ++part_;
+            }
+        } else {
+            buffer_cursor_.Next();
+        }
+    }
+
+    void SkipTo(DocumentOrdinal target);
+
+    double GetBlockMaxTermFreq(DocumentOrdinal target, DocumentOrdinal& block_last) const;
+
+    double GetMaxTermFreq() const {
+        return max_term_freq_;
+    }
+
+    // Вызывает function(ordinal, term_freq) для вхождений с номером меньше last
+    // без перехода между частями на каждом вхождении
+    template <typename Function>
+    void ForEachBefore(DocumentOrdinal last, Function function) {
+        for (; part_ < segment_cursors_.size(); ++part_) {
+            segment_cursors_[part_].ForEachBefore(last, function);
+            if (segment_cursors_[part_].GetOrdinal() != NO_DOCUMENT) {
+                return;
+            }
+        }
+        buffer_cursor_.ForEachBefore(last, function);
+    }
+
+private:
+    std::vector<SegmentCursor> segment_cursors_;
+    PostingCursor buffer_cursor_;
+    size_t part_ = 0;
+    double max_term_freq_;
+};
@@ -0,0 +1,115 @@
+#include "posting_list.h"
+
+#include <algorithm>
+
+using namespace std;
+
+void PostingList::Add(DocumentOrdinal ordinal, uint32_t term_count, double term_freq) {
+    if (ordinals_.empty() || ordinals_.back() < ordinal) {
+        if (ordinals_.size() % BLOCK_SIZE == 0) {
+            block_max_term_freqs_.push_back(term_freq);
+        } else {
+            block_max_term_freqs_.back() = max(block_max_term_freqs_.back(), term_freq);
+        }
+        ordinals_.push_back(ordinal);
+        term_freqs_.push_back(term_freq);
+        term_counts_.push_back(term_count);
+        max_term_freq_ = max(max_term_freq_, term_freq);
+        return;
+    }
+    auto it = lower_bound(ordinals_.begin(), ordinals_.end(), ordinal);
+    const size_t pos = it - ordinals_.begin();
+    if (*it == ordinal) {
+        term_freqs_[pos] += term_freq;
+        term_counts_[pos] += term_count;
+    } else {
+        ordinals_.insert(it, ordinal);
+        term_freqs_.insert(term_freqs_.begin() + pos, term_freq);
+        term_counts_.insert(term_counts_.begin() + pos, term_count);
+    }
+    RebuildBlockMaxTermFreqs(pos / BLOCK_SIZE);
+}
+
+bool PostingList::Erase(DocumentOrdinal ordinal) {
+    auto it = lower_bound(ordinals_.begin(), ordinals_.end(), ordinal);
+    if (it == ordinals_.end() || *it != ordinal) {
+        return false;
+    }
+    const size_t pos = it - ordinals_.begin();
+    ordinals_.erase(it);
+    term_freqs_.erase(term_freqs_.begin() + pos);
+    term_counts_.erase(term_counts_.begin() + pos);
+    RebuildBlockMaxTermFreqs(pos / BLOCK_SIZE);
+    return true;
+}
+
+void PostingList::ShiftOrdinals(DocumentOrdinal offset) {
+    for (DocumentOrdinal & ordinal : ordinals_) {
+        ordinal -= offset;
+    }
+}
+
+bool PostingList::Contains(DocumentOrdinal ordinal) const {
+    return binary_search(ordinals_.begin(), ordinals_.end(), ordinal);
+}
+
+void PostingList::Clear() {
+    ordinals_.clear();
+    term_freqs_.clear();
+    term_counts_.clear();
+    block_max_term_freqs_.clear();
+    max_term_freq_ = 0.0;
+}
+
+void PostingList::RebuildBlockMaxTermFreqs(size_t first_block) {
+    block_max_term_freqs_.resize((term_freqs_.size() + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    for (size_t block = first_block; block < block_max_term_freqs_.size(); ++block) {
+        const auto first = term_freqs_.begin() + block * BLOCK_SIZE;
+        const auto last = term_freqs_.begin() + min(term_freqs_.size(), (block + 1) * BLOCK_SIZE);
+        block_max_term_freqs_[block] = *max_element(first, last);
+    }
+    max_term_freq_ = block_max_term_freqs_.empty()
+        ? 0.0
+        : *max_element(block_max_term_freqs_.begin(), block_max_term_freqs_.end());
+}
+
+void PostingCursor::SkipTo(DocumentOrdinal target) {
+    if (pos_ >= size_ || ordinals_[pos_] >= target) {
+        return;
+    }
+    // галопом находим границу, затем бинарный поиск внутри неё
+    size_t step = 1;
+    size_t low = pos_;
+    size_t high = pos_ + step;
+    while (high < size_ && ordinals_[high] < target) {
+        low = high;
+        step *= 2;
+        high = pos_ + step;
+    }
+    high = min(high, size_);
+    pos_ = lower_bound(ordinals_ + low, ordinals_ + high, target) - ordinals_;
+}
+
+double PostingCursor::GetBlockMaxTermFreq(DocumentOrdinal target, DocumentOrdinal& block_last) const {
+    const size_t block_size = PostingList::BLOCK_SIZE;
+    auto last_of_block = [this, block_size](size_t block) {
+        return ordinals_[min(size_, (block + 1) * block_size) - 1];
+    };
+    // первый блок, последний документ которого не меньше target
+    size_t low = pos_ / block_size;
+    size_t high = (size_ + block_size - 1) / block_size;
+    while (low < high) {
+        const size_t middle = low + (high - low) / 2;
+        if (last_of_block(middle) < target) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low * block_size >= size_) {
+        block_last = NO_DOCUMENT;
+        return 0.0;
+    }
+    block_last = last_of_block(low);
+    return block_max_term_freqs_[low];
+}
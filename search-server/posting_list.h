@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Внутренний порядковый номер документа в индексе
+using DocumentOrdinal = uint32_t;
+
+constexpr DocumentOrdinal NO_DOCUMENT = std::numeric_limits<DocumentOrdinal>::max();
+
+// TF слова, встретившегося term_count раз среди length слов документа.
+// Доли складываются по одной, как при подсчёте по словам текста, поэтому
+// TF, посчитанная заново по числам из сегмента, совпадает до бита.
+inline double ComputeTermFreq(uint32_t term_count, uint32_t length) {
+    const double inv_length = 1.0 / length;
+    double term_freq = 0.0;
+    for (uint32_t i = 0; i < term_count; ++i) {
+        term_freq += inv_length;
+    }
+    return term_freq;
+}
+
+// Список вхождений слова: отсортированные номера документов и параллельные
+// массивы частот слова (TF) в этих документах и числа его повторений, из
+// которых сегмент потом восстанавливает TF. Для динамического отсечения
+// хранится максимальная TF всего списка и каждого блока из BLOCK_SIZE вхождений.
+class PostingList {
+public:
+    static constexpr size_t BLOCK_SIZE = 64;
+
+    // Добавляет к документу term_count повторений слова с частотой term_freq,
+    // создавая вхождение при необходимости. Документы с номером больше
+    // последнего добавляются в конец без поиска.
+    void Add(DocumentOrdinal ordinal, uint32_t term_count, double term_freq);
+
+    // Удаляет документ, возвращает true если он был в списке.
+    bool Erase(DocumentOrdinal ordinal);
+
+    // Уменьшает номера всех документов списка на offset
+    void ShiftOrdinals(DocumentOrdinal offset);
+
+    bool Contains(DocumentOrdinal ordinal) const;
+
+    // Удаляет все вхождения, сохраняя выделенную память
+    void Clear();
+
+    size_t size() const {
+        return ordinals_.size();
+    }
+
+    bool empty() const {
+        return ordinals_.empty();
+    }
+
+    const std::vector<DocumentOrdinal>& GetDocumentOrdinals() const {
+        return ordinals_;
+    }
+
+    const std::vector<double>& GetTermFreqs() const {
+        return term_freqs_;
+    }
+
+    const std::vector<uint32_t>& GetTermCounts() const {
+        return term_counts_;
+    }
+
+    double GetMaxTermFreq() const {
+        return max_term_freq_;
+    }
+
+    const std::vector<double>& GetBlockMaxTermFreqs() const {
+        return block_max_term_freqs_;
+    }
+
+private:
+    std::vector<DocumentOrdinal> ordinals_;
+    std::vector<double> term_freqs_;
+    std::vector<uint32_t> term_counts_;
+    std::vector<double> block_max_term_freqs_;
+    double max_term_freq_ = 0.0;
+
+    void RebuildBlockMaxTermFreqs(size_t first_block);
+};
+
+// Курсор для обхода списка вхождений документ за документом
+class PostingCursor {
+public:
+    explicit PostingCursor(const PostingList& posting_list)
+        : ordinals_(posting_list.GetDocumentOrdinals().data())
+        , term_freqs_(posting_list.GetTermFreqs().data())
+        , term_counts_(posting_list.GetTermCounts().data())
+        , block_max_term_freqs_(posting_list.GetBlockMaxTermFreqs().data())
+        , size_(posting_list.size())
+    {}
+
+    // NO_DOCUMENT, когда список пройден
+    DocumentOrdinal GetOrdinal() const {
+        return pos_ < size_ ? ordinals_[pos_] : NO_DOCUMENT;
+    }
+
+    double GetTermFreq() const {
+        return term_freqs_[pos_];
+    }
+
+    uint32_t GetTermCount() const {
+        return term_counts_[pos_];
+    }
+
+    void Next() {
+        ++pos_;
+    }
+
+    // Переходит к первому документу с номером не меньше target
+    void SkipTo(DocumentOrdinal target);
+
+    // Максимальная TF блока, в котором лежал бы target, не сдвигая курсор;
+    // block_last получает номер последнего документа этого блока.
+    // target должен быть не меньше текущего документа.
+    double GetBlockMaxTermFreq(DocumentOrdinal target, DocumentOrdinal& block_last) const;
+
+    // Вызывает function(ordinal, term_freq) для вхождений с номером меньше last,
+    // оставляя курсор на первом непройденном
+    template <typename Function>
+    void ForEachBefore(DocumentOrdinal last, Function& function) {
+        for (; pos_ < size_ && ordinals_[pos_] < last; ++pos_) {
+            function(ordinals_[pos_], term_freqs_[pos_]);
+        }
+    }
+
+private:
+    const DocumentOrdinal* ordinals_;
+    const double* term_freqs_;
+    const uint32_t* term_counts_;
+    const double* block_max_term_freqs_;
+    size_t size_;
+    size_t pos_ = 0;
+};
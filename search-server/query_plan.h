@@ -0,0 +1,103 @@
+#pragma once
+
+#include "term_dictionary.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <vector>
+
+// Список id слов запроса. Первые INLINE_CAPACITY id лежат в самом объекте,
+// больший список переносится в кучу. Clear сохраняет выделенную память.
+class TermIdList {
+public:
+    static constexpr size_t INLINE_CAPACITY = 16;
+
+    using const_iterator = const TermId*;
+
+    void push_back(TermId term_id) {
+        if (size_ < INLINE_CAPACITY) {
+            inline_terms_[size_++] = term_id;
+            return;
+        }
+        if (size_ == INLINE_CAPACITY) {
+            heap_terms_.assign(inline_terms_.begin(), inline_terms_.end());
+        }
+        heap_terms_.push_back(term_id);
+        ++size_;
+    }
+
+    void clear() {
+        size_ = 0;
+        heap_terms_.clear();
+    }
+
+    const_iterator begin() const {
+        return data();
+    }
+
+    const_iterator end() const {
+        return data() + size_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    TermId operator[](size_t index) const {
+        return data()[index];
+    }
+
+    // Упорядочивает id по возрастанию и убирает повторы
+    void SortUnique() {
+        TermId* first = data();
+        std::sort(first, first + size_);
+        const size_t unique_size = static_cast<size_t>(std::unique(first, first + size_) - first);
+        if (size_ > INLINE_CAPACITY && unique_size <= INLINE_CAPACITY) {
+            std::copy(first, first + unique_size, inline_terms_.begin());
+            heap_terms_.clear();
+        } else if (unique_size > INLINE_CAPACITY) {
+            heap_terms_.resize(unique_size);
+        }
+        size_ = unique_size;
+    }
+
+    bool operator==(const TermIdList& other) const {
+        return std::equal(begin(), end(), other.begin(), other.end());
+    }
+
+private:
+    std::array<TermId, INLINE_CAPACITY> inline_terms_;
+    std::vector<TermId> heap_terms_;
+    size_t size_ = 0;
+
+    TermId* data() {
+        return size_ <= INLINE_CAPACITY ? inline_terms_.data() : heap_terms_.data();
+    }
+
+    const TermId* data() const {
+        return size_ <= INLINE_CAPACITY ? inline_terms_.data() : heap_terms_.data();
+    }
+};
+
+// Разобранный запрос: id плюс- и минус-слов без повторов по возрастанию.
+// Стоп-слова и слова, которых нет в индексе, в план не попадают. Обычный
+// запрос разбирается без выделения памяти, а план, переиспользуемый между
+// запросами, не выделяет её и для длинных.
+struct QueryPlan {
+    TermIdList plus_words;
+    TermIdList minus_words;
+
+    void Clear() {
+        plus_words.clear();
+        minus_words.clear();
+    }
+
+    bool operator==(const QueryPlan& other) const {
+        return plus_words == other.plus_words && minus_words == other.minus_words;
+    }
+};
@@ -2,5 +2,7 @@
 
 #include <string>
 
+// Построчное чтение cin для небольших вводов; наборы документов
+// загружает LoadDocuments из document_loader.h
 std::string ReadLine();
 int ReadLineWithNumber();
\ No newline at end of file
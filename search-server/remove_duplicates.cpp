@@ -1,29 +1,224 @@
 #include "remove_duplicates.h"
 #include "search_server.h"
 
-#include <string>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
 #include <vector>
-#include <map>
-#include <set>
-#include <iostream>
-
-void RemoveDuplicates(SearchServer & search_server) {
-    std::map< std::set<std::string_view>, std::vector<int> > index;
-    for (auto doc_id : search_server) {
-        std::set<std::string_view> set_of_strings;
-        for (auto & [word, _] : search_server.GetWordFrequencies(doc_id)) {
-            set_of_strings.insert(word);
-        }
-        index[set_of_strings].push_back(doc_id);
-    }
-    for (auto & [ss, vectr] : index) {
-        if (vectr.size() != 1) {
-            std::sort(vectr.begin(), vectr.end());
-            for (size_t i = 1; i < vectr.size(); ++i) {
-                int document_id = vectr[i];
-                std::cout << "Found duplicate document id " << document_id << std::endl;
-                search_server.RemoveDocument(document_id);
+
+using namespace std;
+
+namespace {
+
+// столько предшествующих документов корзины LSH сравнивается с каждым,
+// чтобы большие корзины не давали квадратичного числа пар
+constexpr size_t MAX_BUCKET_PEERS = 32;
+constexpr uint64_t MINHASH_SEED = 0x5851F42D4C957F2Dull;
+constexpr uint32_t MAX_HASH = numeric_limits<uint32_t>::max();
+
+bool HaveSameTerms(DocumentTermsView lhs, DocumentTermsView rhs) {
+    return lhs.size() == rhs.size()
+        && equal(lhs.begin(), lhs.end(), rhs.begin(), [](const DocumentTerm& a, const DocumentTerm& b) {
+               return a.term_id == b.term_id;
+           });
+}
+
+// Слова в видах упорядочены по TermId, поэтому пересечение считается слиянием
+double ComputeJaccard(DocumentTermsView lhs, DocumentTermsView rhs) {
+    size_t common = 0;
+    for (auto left = lhs.begin(), right = rhs.begin(); left != lhs.end() && right != rhs.end();) {
+        if (left->term_id < right->term_id) {
+            ++left;
+        } else if (right->term_id < left->term_id) {
+            ++right;
+        } else {
+            ++common;
+            ++left;
+            ++right;
+        }
+    }
+    const size_t united = lhs.size() + rhs.size() - common;
+    return united == 0 ? 1.0 : static_cast<double>(common) / static_cast<double>(united);
+}
+
+// Отмечает в removed документы, множество слов которых совпадает с множеством
+// документа с меньшим id. Документы сравниваются только внутри групп
+// с одинаковым отпечатком, группы обрабатываются параллельно.
+void MarkExactDuplicates(const vector<DocumentFingerprint>& documents, vector<char>& removed) {
+    vector<uint32_t> order(documents.size());
+    iota(order.begin(), order.end(), 0);
+    // документы упорядочены по id, поэтому внутри группы номер задаёт порядок id
+    sort(order.begin(), order.end(), [&documents](uint32_t lhs, uint32_t rhs) {
+        return make_pair(documents[lhs].fingerprint, lhs) < make_pair(documents[rhs].fingerprint, rhs);
+    });
+    vector<size_t> group_starts;
+    for (size_t i = 0; i < order.size(); ++i) {
+        if (i + 1 < order.size() && documents[order[i]].fingerprint == documents[order[i + 1]].fingerprint
+            && (i == 0 || documents[order[i - 1]].fingerprint != documents[order[i]].fingerprint)) {
+            group_starts.push_back(i);
+        }
+    }
+    GetThreadPool().ParallelFor(group_starts.size(), [&](size_t group) {
+        // оставляемые документы группы; больше одного - только при совпадении отпечатков разных множеств
+        vector<uint32_t> kept;
+        const uint64_t fingerprint = documents[order[group_starts[group]]].fingerprint;
+        for (size_t i = group_starts[group]; i < order.size() && documents[order[i]].fingerprint == fingerprint; ++i) {
+            const uint32_t index = order[i];
+            const bool duplicate = any_of(kept.begin(), kept.end(), [&](uint32_t kept_index) {
+                return HaveSameTerms(documents[kept_index].terms, documents[index].terms);
+            });
+            if (duplicate) {
+                removed[index] = 1;
+            } else {
+                kept.push_back(index);
+            }
+        }
+    });
+}
+
+// Сигнатура MinHash: для каждой хеш-функции - минимальный хеш слов документа.
+// Вероятность совпадения значений двух сигнатур равна сходству по Жаккару
+// множеств слов. Функции строятся двойным хешированием: i-я функция слова
+// с хешем (a, b) равна a + i * b, поэтому значение стоит одного сложения.
+void ComputeSignature(DocumentTermsView terms, vector<uint32_t>& signature) {
+    fill(signature.begin(), signature.end(), MAX_HASH);
+    for (const DocumentTerm & term : terms) {
+        const uint64_t hash = HashTermId(term.term_id, MINHASH_SEED);
+        uint32_t value = static_cast<uint32_t>(hash);
+        const uint32_t step = static_cast<uint32_t>(hash >> 32) | 1;
+        for (uint32_t & minimum : signature) {
+            minimum = min(minimum, value);
+            value += step;
+        }
+    }
+}
+
+// Устойчиво сортирует записи по старшим 32 битам поразрядной сортировкой
+// по 16 бит; младшие биты сохраняют исходный порядок внутри ключа
+void SortByHighBits(vector<uint64_t>& entries, vector<uint64_t>& buffer) {
+    constexpr size_t DIGIT_BITS = 16;
+    buffer.resize(entries.size());
+    for (size_t shift = 32; shift < 64; shift += DIGIT_BITS) {
+        vector<size_t> offsets((size_t{1} << DIGIT_BITS) + 1);
+        for (const uint64_t entry : entries) {
+            ++offsets[((entry >> shift) & 0xFFFF) + 1];
+        }
+        partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+        for (const uint64_t entry : entries) {
+            buffer[offsets[(entry >> shift) & 0xFFFF]++] = entry;
+        }
+        entries.swap(buffer);
+    }
+}
+
+// Число строк в полосе LSH: наибольшее, при котором порог сходства
+// (1 / полосы) ^ (1 / строки) не превышает threshold
+size_t ChooseRowCount(size_t signature_size, double threshold) {
+    size_t row_count = 1;
+    for (size_t rows = 1; rows <= signature_size; ++rows) {
+        if (signature_size % rows != 0) {
+            continue;
+        }
+        const double bands = static_cast<double>(signature_size / rows);
+        if (pow(1.0 / bands, 1.0 / static_cast<double>(rows)) <= threshold) {
+            row_count = rows;
+        }
+    }
+    return row_count;
+}
+
+// Отмечает документы, похожие на оставляемый документ с меньшим id
+void MarkNearDuplicates(const vector<DocumentFingerprint>& documents, double threshold, size_t signature_size,
+                        vector<char>& removed) {
+    vector<uint32_t> alive;
+    for (uint32_t index = 0; index < documents.size(); ++index) {
+        if (!removed[index]) {
+            alive.push_back(index);
+        }
+    }
+    signature_size = max<size_t>(signature_size, 1);
+    const size_t row_count = ChooseRowCount(signature_size, threshold);
+    const size_t band_count = signature_size / row_count;
+
+    // ключи полос сигнатуры каждого документа, по полосам подряд
+    vector<uint32_t> band_keys(band_count * alive.size());
+    GetThreadPool().ParallelFor(alive.size(), [&](size_t i) {
+        thread_local vector<uint32_t> signature;
+        signature.resize(signature_size);
+        ComputeSignature(documents[alive[i]].terms, signature);
+        for (size_t band = 0; band < band_count; ++band) {
+            uint64_t key = band;
+            for (size_t row = 0; row < row_count; ++row) {
+                key = (key ^ signature[band * row_count + row]) * 0x100000001B3ull;
+            }
+            band_keys[band * alive.size() + i] = static_cast<uint32_t>(key ^ (key >> 32));
+        }
+    });
+
+    // кандидаты: пары документов, совпавших хотя бы в одной полосе; старшие
+    // 32 бита - больший номер, чтобы пары шли по второму документу
+    vector<uint64_t> candidates;
+    // ключ полосы в старших 32 битах, номер документа - в младших
+    vector<uint64_t> bucket_entries(alive.size());
+    vector<uint64_t> sort_buffer;
+    for (size_t band = 0; band < band_count; ++band) {
+        for (size_t i = 0; i < alive.size(); ++i) {
+            bucket_entries[i] = (uint64_t{band_keys[band * alive.size() + i]} << 32) | alive[i];
+        }
+        SortByHighBits(bucket_entries, sort_buffer);
+        for (size_t i = 1, bucket_start = 0; i < bucket_entries.size(); ++i) {
+            if ((bucket_entries[i] >> 32) != (bucket_entries[i - 1] >> 32)) {
+                bucket_start = i;
+                continue;
+            }
+            for (size_t j = max(bucket_start, i - min(i, MAX_BUCKET_PEERS)); j < i; ++j) {
+                candidates.push_back((bucket_entries[i] << 32) | static_cast<uint32_t>(bucket_entries[j]));
             }
         }
     }
+    sort(candidates.begin(), candidates.end());
+    candidates.erase(unique(candidates.begin(), candidates.end()), candidates.end());
+
+    vector<char> similar(candidates.size());
+    GetThreadPool().ParallelFor(candidates.size(), [&](size_t i) {
+        const auto later = static_cast<uint32_t>(candidates[i] >> 32);
+        const auto earlier = static_cast<uint32_t>(candidates[i]);
+        similar[i] = ComputeJaccard(documents[earlier].terms, documents[later].terms) >= threshold;
+    });
+    // пары идут по возрастанию большего номера, поэтому судьба меньшего уже решена
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        const auto later = static_cast<uint32_t>(candidates[i] >> 32);
+        const auto earlier = static_cast<uint32_t>(candidates[i]);
+        if (similar[i] && !removed[earlier]) {
+            removed[later] = 1;
+        }
+    }
+}
+
+}
+
+vector<int> FindDuplicates(const SearchServer& search_server, const DuplicateSearchOptions& options) {
+    // виды слов указывают в копию индекса, поэтому поиск целиком идёт под чтением
+    return search_server.ReadDocumentFingerprints([&options](const vector<DocumentFingerprint>& documents) {
+        vector<char> removed(documents.size());
+        MarkExactDuplicates(documents, removed);
+        if (options.mode == DuplicateSearchOptions::Mode::NEAR) {
+            MarkNearDuplicates(documents, options.jaccard_threshold, options.signature_size, removed);
+        }
+        vector<int> duplicates;
+        for (size_t index = 0; index < documents.size(); ++index) {
+            if (removed[index]) {
+                duplicates.push_back(documents[index].id);
+            }
+        }
+        return duplicates;
+    });
+}
+
+vector<int> RemoveDuplicates(SearchServer& search_server, const DuplicateSearchOptions& options) {
+    vector<int> duplicates = FindDuplicates(search_server, options);
+    search_server.RemoveDocuments(duplicates);
+    return duplicates;
 }
@@ -1,5 +1,28 @@
-#pragma once 
+#pragma once
+
+#include <cstddef>
+#include <vector>
 
 class SearchServer;
 
-void RemoveDuplicates(SearchServer & search_server);
+struct DuplicateSearchOptions {
+    enum class Mode {
+        // документы с одинаковыми множествами слов
+        EXACT,
+        // документы, множества слов которых похожи по Жаккару не меньше
+        // jaccard_threshold; кандидаты ищутся через MinHash и LSH
+        NEAR,
+    };
+
+    Mode mode = Mode::EXACT;
+    double jaccard_threshold = 0.8;
+    // число значений в сигнатуре MinHash документа
+    size_t signature_size = 128;
+};
+
+// id дубликатов по возрастанию. Документ - дубликат, если у него есть
+// оставляемый документ с меньшим id, совпадающий (EXACT) или похожий (NEAR).
+std::vector<int> FindDuplicates(const SearchServer& search_server, const DuplicateSearchOptions& options = {});
+
+// Удаляет дубликаты, найденные FindDuplicates, и возвращает их id
+std::vector<int> RemoveDuplicates(SearchServer& search_server, const DuplicateSearchOptions& options = {});
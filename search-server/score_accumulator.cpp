@@ -0,0 +1,51 @@
+#include "score_accumulator.h"
+
+using namespace std;
+
+namespace {
+
+vector<unique_ptr<ScoreAccumulator>>& GetAccumulatorPool() {
+    thread_local vector<unique_ptr<ScoreAccumulator>> pool;
+    return pool;
+}
+
+}
+
+ScoreAccumulator::Lease::~Lease() {
+    if (accumulator_) {
+        accumulator_->Clear();
+        GetAccumulatorPool().push_back(move(accumulator_));
+    }
+}
+
+ScoreAccumulator::Lease ScoreAccumulator::Acquire(size_t document_count) {
+    auto& pool = GetAccumulatorPool();
+    unique_ptr<ScoreAccumulator> accumulator;
+    if (pool.empty()) {
+        accumulator = make_unique<ScoreAccumulator>();
+    } else {
+        accumulator = move(pool.back());
+        pool.pop_back();
+    }
+    accumulator->Reserve(document_count);
+    return Lease(move(accumulator));
+}
+
+void ScoreAccumulator::Clear() {
+    for (const DocumentOrdinal ordinal : touched_) {
+        ResetBit(touched_bits_, ordinal);
+    }
+    for (const DocumentOrdinal ordinal : excluded_) {
+        ResetBit(excluded_bits_, ordinal);
+    }
+    touched_.clear();
+    excluded_.clear();
+}
+
+void ScoreAccumulator::Reserve(size_t document_count) {
+    if (scores_.size() < document_count) {
+        scores_.resize(document_count);
+        touched_bits_.resize((document_count + 63) / 64);
+        excluded_bits_.resize((document_count + 63) / 64);
+    }
+}
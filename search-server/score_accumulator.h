@@ -0,0 +1,108 @@
+#pragma once
+
+#include "posting_list.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Плотный накопитель релевантности, индексируемый номером документа.
+// Сбрасывается за O(числа затронутых документов), а память переиспользуется
+// между запросами: после прогрева поиск не выделяет память под накопление.
+class ScoreAccumulator {
+public:
+    // Владеет накопителем из пула текущего потока и возвращает его обратно.
+    // Вложенные запросы в том же потоке получают разные накопители.
+    class Lease {
+    public:
+        explicit Lease(std::unique_ptr<ScoreAccumulator> accumulator)
+            : accumulator_(std::move(accumulator))
+        {}
+        Lease(Lease&&) = default;
+        Lease& operator=(Lease&&) = delete;
+        ~Lease();
+
+        ScoreAccumulator& operator*() const {
+            return *accumulator_;
+        }
+
+        ScoreAccumulator* operator->() const {
+            return accumulator_.get();
+        }
+
+    private:
+        std::unique_ptr<ScoreAccumulator> accumulator_;
+    };
+
+    // Накопитель, вмещающий номера документов меньше document_count
+    static Lease Acquire(size_t document_count);
+
+    void Add(DocumentOrdinal ordinal, double score) {
+        if (!TestBit(touched_bits_, ordinal)) {
+            SetBit(touched_bits_, ordinal);
+            touched_.push_back(ordinal);
+            scores_[ordinal] = 0.0;
+        }
+        scores_[ordinal] += score;
+    }
+
+    // Исключённый документ не попадает в результат, даже если набрал оценку
+    void Exclude(DocumentOrdinal ordinal) {
+        if (!TestBit(excluded_bits_, ordinal)) {
+            SetBit(excluded_bits_, ordinal);
+            excluded_.push_back(ordinal);
+        }
+    }
+
+    bool IsExcluded(DocumentOrdinal ordinal) const {
+        return TestBit(excluded_bits_, ordinal);
+    }
+
+    // Вызывает function(ordinal, score) для неисключённых документов по возрастанию номера
+    template <typename Function>
+    void ForEach(Function function) {
+        // когда затронута заметная доля документов, обход битов дешевле сортировки списка
+        if (touched_.size() * DENSE_SCAN_RATIO >= touched_bits_.size()) {
+            for (size_t word = 0; word < touched_bits_.size(); ++word) {
+                for (uint64_t bits = touched_bits_[word] & ~excluded_bits_[word]; bits != 0; bits &= bits - 1) {
+                    const auto ordinal = static_cast<DocumentOrdinal>(word * 64 + __builtin_ctzll(bits));
+                    function(ordinal, scores_[ordinal]);
+                }
+            }
+            return;
+        }
+        std::sort(touched_.begin(), touched_.end());
+        for (const DocumentOrdinal ordinal : touched_) {
+            if (!IsExcluded(ordinal)) {
+                function(ordinal, scores_[ordinal]);
+            }
+        }
+    }
+
+    void Clear();
+
+private:
+    // обход битов выбирается, если затронут хотя бы один документ на столько слов битовой карты
+    static constexpr size_t DENSE_SCAN_RATIO = 16;
+
+    std::vector<double> scores_;
+    std::vector<uint64_t> touched_bits_;
+    std::vector<uint64_t> excluded_bits_;
+    std::vector<DocumentOrdinal> touched_;
+    std::vector<DocumentOrdinal> excluded_;
+
+    void Reserve(size_t document_count);
+
+    static bool TestBit(const std::vector<uint64_t>& bits, DocumentOrdinal ordinal) {
+        return (bits[ordinal / 64] >> (ordinal % 64)) & 1u;
+    }
+
+    static void SetBit(std::vector<uint64_t>& bits, DocumentOrdinal ordinal) {
+        bits[ordinal / 64] |= uint64_t{1} << (ordinal % 64);
+    }
+
+    static void ResetBit(std::vector<uint64_t>& bits, DocumentOrdinal ordinal) {
+        bits[ordinal / 64] &= ~(uint64_t{1} << (ordinal % 64));
+    }
+};
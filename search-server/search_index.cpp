@@ -0,0 +1,896 @@
+#include "search_index.h"
+#include "read_input_functions.h"
+#include "string_processing.h"
+#include <cmath>
+#include <numeric>
+#include <unordered_map>
+
+using namespace std;
+
+namespace {
+
+// Удаляет из колонки элементы с номерами из ordinals (отсортированы)
+template <typename Column>
+void EraseOrdinals(Column& column, const vector<DocumentOrdinal>& ordinals) {
+    auto removed = ordinals.begin();
+    size_t size = ordinals.front();
+    for (size_t ordinal = ordinals.front(); ordinal < column.size(); ++ordinal) {
+        if (removed != ordinals.end() && *removed == ordinal) {
+            ++removed;
+        } else {
+            column[size++] = move(column[ordinal]);
+        }
+    }
+    column.resize(size);
+}
+
+}
+
+SearchIndex::SearchIndex(const string & stop_words) {
+    SetStopWords(stop_words);
+}
+
+void SearchIndex::SetStopWords(const string& text) {
+    // до изменения: стоп-слова перед ошибочным словом остаются добавленными
+    ++generation_;
+    ++query_generation_;
+    for (const TextWord & word : WordTokenizer(text)) {
+        if (word.has_special_symbols) {
+            throw invalid_argument("SetStopWords: Invalid stop word='"s + string{word.text} + "'"s);
+        }
+        stop_words_.insert(string{word.text});
+    }
+}
+
+void SearchIndex::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    CheckNewDocumentId(document_id);
+    // буфер слов переиспользуется между вызовами, чтобы не выделять память на каждый документ
+    thread_local vector<string_view> words;
+    SplitIntoWordsNoStop(document, words);
+    // слова по алфавиту: в этом порядке они попадают в словарь
+    sort(words.begin(), words.end());
+    const auto length = static_cast<uint32_t>(words.size());
+    size_t term_count = 0;
+    for (size_t i = 0; i < words.size(); ++i) {
+        term_count += i == 0 || words[i] != words[i - 1];
+    }
+    ++generation_;
+    const DocumentOrdinal ordinal = static_cast<DocumentOrdinal>(document_ids_.size());
+    forward_index_.AddDocument(term_count);
+    DocumentTerm* terms = forward_index_.GetMutableTerms(ordinal);
+    for (size_t begin = 0, end = 0; begin < words.size(); begin = end) {
+        while (end < words.size() && words[end] == words[begin]) {
+            ++end;
+        }
+        const auto count = static_cast<uint32_t>(end - begin);
+        const double term_freq = ComputeTermFreq(count, length);
+        const TermId term_id = term_dictionary_.Intern(words[begin]);
+        if (term_id == buffer_posting_lists_.size()) {
+            buffer_posting_lists_.emplace_back();
+            document_freqs_.emplace_back();
+            log_document_freqs_.emplace_back();
+        }
+        PostingList & posting_list = buffer_posting_lists_[term_id];
+        if (posting_list.empty()) {
+            buffer_terms_.push_back(term_id);
+        }
+        posting_list.Add(ordinal, count, term_freq);
+        if (document_freqs_[term_id]++ == 0) {
+            ++query_generation_;
+        }
+        UpdateDocumentFreq(term_id);
+        *terms++ = {term_id, term_freq};
+    }
+    DocumentTerm* first_term = forward_index_.GetMutableTerms(ordinal);
+    sort(first_term, terms, [](const DocumentTerm& lhs, const DocumentTerm& rhs) {
+        return lhs.term_id < rhs.term_id;
+    });
+    forward_index_.UpdateFingerprint(ordinal);
+    document_ids_.push_back(document_id);
+    document_ratings_.push_back(ComputeAverageRating(ratings));
+    document_statuses_.push_back(status);
+    buffer_document_lengths_.push_back(length);
+    status_documents_[static_cast<size_t>(status)].Add(ordinal);
+    document_ordinals_.emplace(document_id, ordinal);
+    UpdateDocumentCount();
+}
+
+void SearchIndex::AddDocuments(const DocumentBatch& batch, size_t first, size_t last) {
+    // id слов частей в словаре индекса; назначаются при первой встрече слова,
+    // поэтому словарь заполняется в том же порядке, что и при AddDocument
+    const size_t first_part = first / PART_DOCUMENT_COUNT;
+    vector<vector<TermId>> part_term_ids((last + PART_DOCUMENT_COUNT - 1) / PART_DOCUMENT_COUNT - first_part);
+    auto get_words = [&batch](size_t index) {
+        const DocumentBatch::PreparedDocument & document = batch.documents[index];
+        const auto & words = batch.parts[index / PART_DOCUMENT_COUNT].words;
+        return make_pair(words.begin() + document.first_word, words.begin() + document.first_word + document.word_count);
+    };
+
+    const size_t first_ordinal = document_ids_.size();
+    ++generation_;
+    exception_ptr error;
+    for (size_t index = first; index < last; ++index) {
+        const DocumentBatch::PreparedDocument & document = batch.documents[index];
+        try {
+            CheckNewDocumentId(document.id);
+        } catch (...) {
+            error = current_exception();
+            break;
+        }
+        if (document.error) {
+            error = document.error;
+            break;
+        }
+        const DocumentBatch::Part & part = batch.parts[index / PART_DOCUMENT_COUNT];
+        vector<TermId> & term_ids = part_term_ids[index / PART_DOCUMENT_COUNT - first_part];
+        if (term_ids.size() != part.terms.size()) {
+            term_ids.assign(part.terms.size(), NO_TERM);
+        }
+        const auto ordinal = static_cast<DocumentOrdinal>(document_ids_.size());
+        const auto [words_begin, words_end] = get_words(index);
+        for (auto word = words_begin; word != words_end; ++word) {
+            TermId & term_id = term_ids[word->first];
+            if (term_id == NO_TERM) {
+                term_id = term_dictionary_.Intern(part.terms[word->first]);
+                if (term_id == buffer_posting_lists_.size()) {
+                    buffer_posting_lists_.emplace_back();
+                    document_freqs_.emplace_back();
+                    log_document_freqs_.emplace_back();
+                }
+            }
+            PostingList & posting_list = buffer_posting_lists_[term_id];
+            if (posting_list.empty()) {
+                buffer_terms_.push_back(term_id);
+            }
+            posting_list.Add(ordinal, word->second, ComputeTermFreq(word->second, document.length));
+            if (document_freqs_[term_id]++ == 0) {
+                ++query_generation_;
+            }
+        }
+        document_ids_.push_back(document.id);
+        document_ratings_.push_back(document.rating);
+        document_statuses_.push_back(document.status);
+        buffer_document_lengths_.push_back(document.length);
+        status_documents_[static_cast<size_t>(document.status)].Add(ordinal);
+        document_ordinals_.emplace(document.id, ordinal);
+        forward_index_.AddDocument(document.word_count);
+    }
+
+    // слова документов в прямом индексе не зависят друг от друга и заполняются параллельно
+    const size_t added_count = document_ids_.size() - first_ordinal;
+    auto fill_word_freqs = [&](size_t offset) {
+        const size_t index = first + offset;
+        const vector<TermId> & term_ids = part_term_ids[index / PART_DOCUMENT_COUNT - first_part];
+        const auto ordinal = static_cast<DocumentOrdinal>(first_ordinal + offset);
+        DocumentTerm* const first_term = forward_index_.GetMutableTerms(ordinal);
+        DocumentTerm* term = first_term;
+        const auto [words_begin, words_end] = get_words(index);
+        for (auto word = words_begin; word != words_end; ++word) {
+            *term++ = {term_ids[word->first], ComputeTermFreq(word->second, batch.documents[index].length)};
+        }
+        sort(first_term, term, [](const DocumentTerm& lhs, const DocumentTerm& rhs) {
+            return lhs.term_id < rhs.term_id;
+        });
+        forward_index_.UpdateFingerprint(ordinal);
+    };
+    if (batch.parallel) {
+        GetThreadPool().ParallelFor(added_count, fill_word_freqs);
+    } else {
+        for (size_t offset = 0; offset < added_count; ++offset) {
+            fill_word_freqs(offset);
+        }
+    }
+    for (const vector<TermId> & term_ids : part_term_ids) {
+        for (const TermId term_id : term_ids) {
+            if (term_id != NO_TERM) {
+                UpdateDocumentFreq(term_id);
+            }
+        }
+    }
+    UpdateDocumentCount();
+    if (error) {
+        rethrow_exception(error);
+    }
+}
+
+void SearchIndex::RemoveDocument(int document_id) {
+    RemoveDocument(std::execution::seq, document_id);
+}
+
+DocumentTermsView SearchIndex::GetDocumentTerms(int document_id) const {
+    const auto it_to_ordinal = document_ordinals_.find(document_id);
+    if (it_to_ordinal == document_ordinals_.end()) {
+        return {};
+    }
+    return forward_index_.GetTerms(it_to_ordinal->second);
+}
+
+vector<DocumentFingerprint> SearchIndex::GetDocumentFingerprints() const {
+    vector<DocumentFingerprint> fingerprints;
+    fingerprints.reserve(document_ordinals_.size());
+    for (const auto [document_id, ordinal] : document_ordinals_) {
+        fingerprints.push_back({document_id, forward_index_.GetFingerprint(ordinal), forward_index_.GetTerms(ordinal)});
+    }
+    return fingerprints;
+}
+
+map<string_view, double> SearchIndex::GetWordFrequencies(int document_id) const {
+    map<string_view, double> word_freqs;
+    for (const DocumentTerm & term : GetDocumentTerms(document_id)) {
+        word_freqs.emplace(term_dictionary_.GetTerm(term.term_id), term.term_freq);
+    }
+    return word_freqs;
+}
+
+std::vector<Document> SearchIndex::FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+                                                     size_t max_count) const {
+    return FindTopDocuments(std::execution::seq, raw_query, status, max_count);
+}
+
+int SearchIndex::GetDocumentCount() const {
+    return document_ordinals_.size();
+}
+
+MatchedWords SearchIndex::MatchDocument(string_view raw_query, int document_id) const {
+    return MatchDocument(std::execution::seq, raw_query, document_id);
+}
+
+vector<vector<Document>> SearchIndex::FindTopDocumentsBatch(const vector<QueryPlan>& queries,
+                                                            DocumentStatus status, size_t max_count,
+                                                            size_t window_posting_count) const {
+    // слова всех запросов пакета по возрастанию, каждое один раз
+    vector<TermId> terms;
+    for (const QueryPlan & query : queries) {
+        terms.insert(terms.end(), query.plus_words.begin(), query.plus_words.end());
+        terms.insert(terms.end(), query.minus_words.begin(), query.minus_words.end());
+    }
+    sort(terms.begin(), terms.end());
+    terms.erase(unique(terms.begin(), terms.end()), terms.end());
+    auto get_term_index = [&terms](TermId term_id) {
+        return static_cast<size_t>(lower_bound(terms.begin(), terms.end(), term_id) - terms.begin());
+    };
+    size_t posting_count = 0;
+    for (const TermId term_id : terms) {
+        posting_count += document_freqs_[term_id];
+    }
+
+    // вхождения слова в окне: смещения документов от начала окна и вклады TF * IDF
+    struct WindowPostings {
+        vector<DocumentOrdinal> offsets;
+        vector<double> scores;
+    };
+    vector<WindowPostings> postings(terms.size());
+    vector<TopDocumentsCollector> top_documents(queries.size(), TopDocumentsCollector(max_count));
+    ThreadPool & thread_pool = GetThreadPool();
+    const size_t document_count = document_ids_.size();
+    window_posting_count = max<size_t>(window_posting_count, 1);
+    const size_t window_count = max<size_t>(1, min(document_count, (posting_count + window_posting_count - 1) / window_posting_count));
+    for (size_t window = 0; window < window_count; ++window) {
+        const auto first = static_cast<DocumentOrdinal>(document_count * window / window_count);
+        const auto last = static_cast<DocumentOrdinal>(document_count * (window + 1) / window_count);
+        thread_pool.ParallelFor(terms.size(), [&](size_t index) {
+            WindowPostings & term_postings = postings[index];
+            term_postings.offsets.clear();
+            term_postings.scores.clear();
+            TermCursor cursor = GetTermCursor(terms[index]);
+            cursor.SkipTo(first);
+            cursor.ForEachBefore(last, [first, &term_postings](DocumentOrdinal ordinal, double term_freq) {
+                term_postings.offsets.push_back(ordinal - first);
+                term_postings.scores.push_back(term_freq);
+            });
+            // отдельный проход без ветвлений компилятор векторизует
+            const double inverse_document_freq = GetInverseDocumentFreq(terms[index]);
+            for (double & score : term_postings.scores) {
+                score *= inverse_document_freq;
+            }
+        });
+        thread_pool.ParallelFor(queries.size(), [&](size_t query_index) {
+            const QueryPlan & query = queries[query_index];
+            const auto accumulator = ScoreAccumulator::Acquire(last - first);
+            for (const TermId term_id : query.minus_words) {
+                for (const DocumentOrdinal offset : postings[get_term_index(term_id)].offsets) {
+                    accumulator->Exclude(offset);
+                }
+            }
+            for (const TermId term_id : query.plus_words) {
+                if (document_freqs_[term_id] == 0) {
+                    continue;
+                }
+                const WindowPostings & term_postings = postings[get_term_index(term_id)];
+                for (size_t i = 0; i < term_postings.offsets.size(); ++i) {
+                    if (!accumulator->IsExcluded(term_postings.offsets[i])) {
+                        accumulator->Add(term_postings.offsets[i], term_postings.scores[i]);
+                    }
+                }
+            }
+            accumulator->ForEach([&](DocumentOrdinal offset, double relevance) {
+                const DocumentOrdinal ordinal = first + offset;
+                if (!IsRemoved(ordinal) && document_statuses_[ordinal] == status) {
+                    top_documents[query_index].Push({document_ids_[ordinal], relevance, document_ratings_[ordinal]});
+                }
+            });
+        });
+    }
+
+    vector<vector<Document>> results;
+    results.reserve(queries.size());
+    for (TopDocumentsCollector & query_top_documents : top_documents) {
+        results.push_back(query_top_documents.Extract());
+    }
+    return results;
+}
+
+DocumentOrdinal SearchIndex::GetMatchOrdinal(int document_id) const {
+    const auto it_to_ordinal = document_ordinals_.find(document_id);
+    if (it_to_ordinal == document_ordinals_.end()) {
+        throw std::out_of_range("MatchDocument: document_id "
+            + std::to_string(document_id) + " not found.");
+    }
+    return it_to_ordinal->second;
+}
+
+MatchedWords SearchIndex::MatchOrdinal(const QueryPlan& query, DocumentOrdinal ordinal) const {
+    const DocumentStatus status = document_statuses_[ordinal];
+    const DocumentTermsView terms = forward_index_.GetTerms(ordinal);
+    for (const TermId term_id : query.minus_words) {
+        if (terms.Contains(term_id)) {
+            return MatchedWords{ std::vector<std::string_view>{}, status };
+        }
+    }
+    std::vector<std::string_view> matched_words;
+    matched_words.reserve(query.plus_words.size());
+    for (const TermId term_id : query.plus_words) {
+        if (terms.Contains(term_id)) {
+            matched_words.push_back(term_dictionary_.GetTerm(term_id));
+        }
+    }
+    // слова плана упорядочены по TermId, то есть по первому появлению в индексе
+    sort(matched_words.begin(), matched_words.end());
+    return { matched_words, status };
+}
+
+bool SearchIndex::IsStopWord(string_view word) const {
+    return stop_words_.count(word) > 0;
+}
+
+void SearchIndex::SplitIntoWordsNoStop(string_view text, vector<string_view>& words) const {
+    words.clear();
+    for (const TextWord & word : WordTokenizer(text)) {
+        if (word.has_special_symbols) {
+            throw invalid_argument("SplitIntoWordsNoStop: invalid symbols='"s + string{text} + "'"s);
+        }
+        if (!IsStopWord(word.text)) {
+            words.push_back(word.text);
+        }
+    }
+}
+
+void SearchIndex::MarkDocumentRemoved(map<int, DocumentOrdinal>::iterator iterator) {
+    ++generation_;
+    const DocumentOrdinal ordinal = iterator->second;
+    forward_index_.RemoveDocument(ordinal);
+    status_documents_[static_cast<size_t>(document_statuses_[ordinal])].Remove(ordinal);
+    removed_documents_.Add(ordinal);
+    if (ordinal < buffer_first_ordinal_) {
+        ++segment_removed_count_;
+    }
+    document_ordinals_.erase(iterator);
+}
+
+void SearchIndex::CheckNewDocumentId(int document_id) const {
+    if (document_id < 0) {
+        throw invalid_argument("AddDocument: document_id < 0");
+    }
+    if (document_ordinals_.count(document_id) > 0) {
+        throw invalid_argument("AddDocument: document_id=" + to_string(document_id) + " already exist");
+    }
+}
+
+void SearchIndex::PrepareDocumentPart(const vector<NewDocument>& documents, size_t part_index, DocumentBatch& batch) const {
+    DocumentBatch::Part & part = batch.parts[part_index];
+    unordered_map<string_view, uint32_t> local_term_ids;
+    vector<string_view> words;
+    const size_t first = part_index * PART_DOCUMENT_COUNT;
+    const size_t last = min(documents.size(), first + PART_DOCUMENT_COUNT);
+    for (size_t index = first; index < last; ++index) {
+        const NewDocument & document = documents[index];
+        DocumentBatch::PreparedDocument & prepared = batch.documents[index];
+        prepared.id = document.id;
+        prepared.status = document.status;
+        prepared.rating = ComputeAverageRating(document.ratings);
+        prepared.first_word = static_cast<uint32_t>(part.words.size());
+        prepared.word_count = 0;
+        prepared.length = 0;
+        try {
+            SplitIntoWordsNoStop(document.text, words);
+        } catch (...) {
+            prepared.error = current_exception();
+            continue;
+        }
+        sort(words.begin(), words.end());
+        prepared.length = static_cast<uint32_t>(words.size());
+        for (size_t begin = 0, end = 0; begin < words.size(); begin = end) {
+            while (end < words.size() && words[end] == words[begin]) {
+                ++end;
+            }
+            const auto [it, inserted] = local_term_ids.emplace(words[begin], static_cast<uint32_t>(part.terms.size()));
+            if (inserted) {
+                part.terms.push_back(words[begin]);
+            }
+            part.words.emplace_back(it->second, static_cast<uint32_t>(end - begin));
+        }
+        prepared.word_count = static_cast<uint32_t>(part.words.size()) - prepared.first_word;
+    }
+}
+
+int SearchIndex::ComputeAverageRating(const vector<int>& ratings) {
+    if (ratings.empty()) {
+        return 0;
+    }
+    int rating_sum = std::accumulate(ratings.begin(), ratings.end(), 0);
+    return rating_sum / static_cast<int>(ratings.size());
+}
+
+SearchIndex::QueryWord SearchIndex::ParseQueryWord(string_view text, bool has_special_symbols) const {
+    if (text.empty()) {
+        throw invalid_argument("ParseQueryWord: empty word"s);
+    }
+    if (has_special_symbols) {
+        throw invalid_argument("ParseQueryWord: invalid symbols '"s + string{text} + "'"s);
+    }
+    QueryWord result;
+    result.is_minus = false;
+    result.is_stop = false;
+    if (text[0] == '-') {
+        result.is_minus = true;
+        if (text.size() == 1) {
+            throw invalid_argument("ParseQueryWord: empty minus word"s);
+        } else {
+            if (text[1] == '-') {
+                throw invalid_argument("ParseQueryWord: minus word contents --"s);
+            } else {
+                result.data = text.substr(1);
+            }
+        }
+    }
+    if (result.data.empty()) {
+        result.data = text;
+    }
+    result.is_stop = IsStopWord(text);
+    return result;
+}
+
+void SearchIndex::ParseQuery(string_view text, QueryPlan& plan) const {
+    plan.Clear();
+    for (const TextWord & word : WordTokenizer(text)) {
+        const QueryWord query_word = ParseQueryWord(word.text, word.has_special_symbols);
+        if (!query_word.is_stop) {
+            // слова, которых нет в индексе, не влияют на результат
+            const TermId term_id = term_dictionary_.Find(query_word.data);
+            if (term_id != NO_TERM && document_freqs_[term_id] > 0) {
+                auto & term_ids = query_word.is_minus ? plan.minus_words : plan.plus_words;
+                term_ids.push_back(term_id);
+            }
+        }
+    }
+    plan.plus_words.SortUnique();
+    plan.minus_words.SortUnique();
+}
+
+void SearchIndex::UpdateDocumentFreq(TermId term_id) {
+    const size_t document_freq = document_freqs_[term_id];
+    log_document_freqs_[term_id] = document_freq > 0 ? log(static_cast<double>(document_freq)) : 0.0;
+}
+
+void SearchIndex::UpdateDocumentCount() {
+    const int document_count = GetDocumentCount();
+    log_document_count_ = document_count > 0 ? log(static_cast<double>(document_count)) : 0.0;
+}
+
+DocumentIdIterator SearchIndex::begin() const {
+    return DocumentIdIterator(document_ordinals_.begin());
+}
+
+DocumentIdIterator SearchIndex::end() const {
+    return DocumentIdIterator(document_ordinals_.end());
+}
+
+bool SearchIndex::IsBufferFull() const {
+    return document_ids_.size() - buffer_first_ordinal_ >= BUFFER_DOCUMENT_COUNT;
+}
+
+void SearchIndex::SaveSnapshot(const string& path, uint64_t log_position) const {
+    SnapshotWriter writer(path);
+
+    // стоп-слова через пробел, как их принимает SetStopWords
+    string stop_words;
+    for (const string & word : stop_words_) {
+        if (!stop_words.empty()) {
+            stop_words += ' ';
+        }
+        stop_words += word;
+    }
+    writer.BeginSection(SnapshotSectionKind::STOP_WORDS);
+    writer.Write(stop_words.data(), stop_words.size());
+    writer.EndSection();
+
+    // строки словаря подряд и смещения их концов
+    vector<uint64_t> term_offsets{0};
+    for (TermId term_id = 0; term_id < term_dictionary_.size(); ++term_id) {
+        term_offsets.push_back(term_offsets.back() + term_dictionary_.GetTerm(term_id).size());
+    }
+    writer.BeginSection(SnapshotSectionKind::TERM_OFFSETS);
+    writer.Write(term_offsets);
+    writer.EndSection();
+    writer.BeginSection(SnapshotSectionKind::TERM_CHARS);
+    for (TermId term_id = 0; term_id < term_dictionary_.size(); ++term_id) {
+        const string_view term = term_dictionary_.GetTerm(term_id);
+        writer.Write(term.data(), term.size());
+    }
+    writer.EndSection();
+
+    auto write_section = [&writer](SnapshotSectionKind kind, const auto & values) {
+        writer.BeginSection(kind);
+        writer.Write(values);
+        writer.EndSection();
+    };
+    write_section(SnapshotSectionKind::DOCUMENT_FREQS, document_freqs_);
+    write_section(SnapshotSectionKind::DOCUMENT_IDS, document_ids_);
+    write_section(SnapshotSectionKind::DOCUMENT_RATINGS, document_ratings_);
+    write_section(SnapshotSectionKind::DOCUMENT_STATUSES, document_statuses_);
+
+    forward_index_.Save(writer);
+
+    // буфер записывается сегментом вместе с удалёнными документами, чтобы
+    // номера документов в снимке не менялись; они становятся метками
+    const auto last = static_cast<DocumentOrdinal>(document_ids_.size());
+    write_section(SnapshotSectionKind::TOMBSTONES, GetRemovedOrdinals(0, last));
+    for (const auto & segment : segments_) {
+        segment->Save(writer);
+    }
+    if (last > buffer_first_ordinal_) {
+        IndexSegment::Build(buffer_posting_lists_, GetBufferTerms(), buffer_first_ordinal_, last,
+                            buffer_document_lengths_, {})->Save(writer);
+    }
+    writer.BeginSection(SnapshotSectionKind::LOG_POSITION);
+    writer.Write(&log_position, 1);
+    writer.EndSection();
+
+    // статус удалённого документа остаётся прежним, поэтому удаление хранится отдельно
+    vector<char> live(document_ids_.size());
+    for (const auto & [document_id, ordinal] : document_ordinals_) {
+        live[ordinal] = 1;
+    }
+    vector<DocumentOrdinal> removed_ordinals;
+    for (DocumentOrdinal ordinal = 0; ordinal < live.size(); ++ordinal) {
+        if (!live[ordinal]) {
+            removed_ordinals.push_back(ordinal);
+        }
+    }
+    write_section(SnapshotSectionKind::REMOVED_DOCUMENTS, removed_ordinals);
+    writer.Finish();
+}
+
+SearchIndex SearchIndex::OpenSnapshot(const SnapshotReader& reader) {
+    const shared_ptr<const MappedFile> & file = reader.GetFile();
+    auto check = [](bool condition) {
+        if (!condition) {
+            throw runtime_error("OpenSnapshot: inconsistent snapshot"s);
+        }
+    };
+
+    SearchIndex index;
+    const auto stop_words = reader.GetSection(SnapshotSectionKind::STOP_WORDS);
+    index.SetStopWords(string(reinterpret_cast<const char*>(stop_words.data), stop_words.size));
+
+    size_t offset_count;
+    const auto* term_offsets = reader.GetArray<uint64_t>(SnapshotSectionKind::TERM_OFFSETS, offset_count);
+    const auto term_chars = reader.GetSection(SnapshotSectionKind::TERM_CHARS);
+    check(offset_count > 0 && term_offsets[0] == 0 && term_offsets[offset_count - 1] <= term_chars.size);
+    const size_t term_count = offset_count - 1;
+    index.term_dictionary_.Reserve(term_count);
+    for (size_t i = 0; i < term_count; ++i) {
+        check(term_offsets[i] <= term_offsets[i + 1]);
+        const string_view term(reinterpret_cast<const char*>(term_chars.data) + term_offsets[i],
+                               term_offsets[i + 1] - term_offsets[i]);
+        // пустая строка - свободный id удалённого слова
+        if (term.empty()) {
+            index.term_dictionary_.AddErased();
+            continue;
+        }
+        check(index.term_dictionary_.Find(term) == NO_TERM);
+        index.term_dictionary_.AddStored(term);
+    }
+
+    size_t count;
+    const auto* document_freqs = reader.GetArray<uint32_t>(SnapshotSectionKind::DOCUMENT_FREQS, count);
+    check(count == term_count);
+    index.document_freqs_.assign(document_freqs, document_freqs + term_count);
+    index.log_document_freqs_.resize(term_count);
+    for (TermId term_id = 0; term_id < term_count; ++term_id) {
+        check(!index.term_dictionary_.GetTerm(term_id).empty() || document_freqs[term_id] == 0);
+        index.UpdateDocumentFreq(term_id);
+    }
+    index.buffer_posting_lists_.resize(term_count);
+
+    size_t document_count;
+    const auto* ids = reader.GetArray<int>(SnapshotSectionKind::DOCUMENT_IDS, document_count);
+    const auto* ratings = reader.GetArray<int>(SnapshotSectionKind::DOCUMENT_RATINGS, count);
+    check(count == document_count);
+    const auto* statuses = reader.GetArray<DocumentStatus>(SnapshotSectionKind::DOCUMENT_STATUSES, count);
+    check(count == document_count);
+    index.document_ids_.assign(ids, ids + document_count);
+    index.document_ratings_.assign(ratings, ratings + document_count);
+    index.document_statuses_.assign(statuses, statuses + document_count);
+
+    vector<char> removed(document_count);
+    const auto* removed_ordinals = reader.GetArray<DocumentOrdinal>(SnapshotSectionKind::REMOVED_DOCUMENTS, count);
+    for (size_t i = 0; i < count; ++i) {
+        check(removed_ordinals[i] < document_count);
+        removed[removed_ordinals[i]] = 1;
+    }
+    for (DocumentOrdinal ordinal = 0; ordinal < document_count; ++ordinal) {
+        const DocumentStatus status = index.document_statuses_[ordinal];
+        check(static_cast<size_t>(status) < STATUS_COUNT);
+        if (!removed[ordinal]) {
+            index.status_documents_[static_cast<size_t>(status)].Add(ordinal);
+            check(index.document_ordinals_.emplace(index.document_ids_[ordinal], ordinal).second);
+        }
+    }
+
+    index.forward_index_ = ForwardIndex::Open(reader, document_count, term_count);
+
+    const auto* tombstones = reader.GetArray<DocumentOrdinal>(SnapshotSectionKind::TOMBSTONES, count);
+    for (size_t i = 0; i < count; ++i) {
+        check(tombstones[i] < document_count && removed[tombstones[i]]);
+        index.removed_documents_.Add(tombstones[i]);
+    }
+    index.segment_removed_count_ = count;
+
+    for (const auto section : reader.GetSections(SnapshotSectionKind::SEGMENT)) {
+        auto segment = IndexSegment::Open(section, file);
+        check(segment->GetDocumentCount() <= document_count - index.buffer_first_ordinal_);
+        index.buffer_first_ordinal_ += static_cast<DocumentOrdinal>(segment->GetDocumentCount());
+        index.segment_document_count_ += segment->GetDocumentCount();
+        index.segments_.push_back(move(segment));
+    }
+    check(index.buffer_first_ordinal_ == document_count);
+    index.UpdateDocumentCount();
+    index.snapshot_file_ = file;
+    return index;
+}
+
+uint64_t SearchIndex::GetSnapshotLogPosition(const SnapshotReader& reader) {
+    size_t count;
+    const auto* log_position = reader.GetArray<uint64_t>(SnapshotSectionKind::LOG_POSITION, count);
+    if (count != 1) {
+        throw runtime_error("OpenSnapshot: inconsistent snapshot"s);
+    }
+    return *log_position;
+}
+
+size_t SearchIndex::GetBufferFreeCount() const {
+    return IsBufferFull() ? 0 : BUFFER_DOCUMENT_COUNT - (document_ids_.size() - buffer_first_ordinal_);
+}
+
+vector<TermId> SearchIndex::GetBufferTerms() const {
+    vector<TermId> terms;
+    terms.reserve(buffer_terms_.size());
+    for (const TermId term_id : buffer_terms_) {
+        if (!buffer_posting_lists_[term_id].empty()) {
+            terms.push_back(term_id);
+        }
+    }
+    sort(terms.begin(), terms.end());
+    terms.erase(unique(terms.begin(), terms.end()), terms.end());
+    return terms;
+}
+
+shared_ptr<const IndexSegment> SearchIndex::BuildBufferSegment() const {
+    const auto last = static_cast<DocumentOrdinal>(document_ids_.size());
+    return IndexSegment::Build(buffer_posting_lists_, GetBufferTerms(), buffer_first_ordinal_, last,
+                               buffer_document_lengths_, GetRemovedOrdinals(buffer_first_ordinal_, last));
+}
+
+void SearchIndex::FlushBuffer(shared_ptr<const IndexSegment> segment) {
+    for (const TermId term_id : buffer_terms_) {
+        buffer_posting_lists_[term_id].Clear();
+    }
+    vector<TermId> buffer_terms = move(buffer_terms_);
+    buffer_terms_.clear();
+    buffer_document_lengths_.clear();
+    // удалённые документы буфера в сегмент не попали, их номера освобождаются
+    const vector<DocumentOrdinal> removed_ordinals
+        = GetRemovedOrdinals(buffer_first_ordinal_, static_cast<DocumentOrdinal>(document_ids_.size()));
+    for (const DocumentOrdinal ordinal : removed_ordinals) {
+        removed_documents_.Remove(ordinal);
+    }
+    buffer_first_ordinal_ = static_cast<DocumentOrdinal>(document_ids_.size());
+    RenumberDocuments(removed_ordinals);
+    segment_document_count_ += segment->GetDocumentCount();
+    segments_.push_back(move(segment));
+    EraseDeadTerms(move(buffer_terms));
+}
+
+optional<SearchIndex::SegmentMerge> SearchIndex::PlanSegmentMerge() const {
+    auto get_tier = [](size_t document_count) {
+        size_t tier = 0;
+        for (size_t size = BUFFER_DOCUMENT_COUNT * MERGE_FACTOR; document_count >= size; size *= MERGE_FACTOR) {
+            ++tier;
+        }
+        return tier;
+    };
+    // номера удалённых документов сегментов [first, last) относительно начала first
+    auto make_merge = [this](size_t first, size_t last, DocumentOrdinal first_ordinal) {
+        SegmentMerge merge;
+        merge.segments.assign(segments_.begin() + first, segments_.begin() + last);
+        DocumentOrdinal last_ordinal = first_ordinal;
+        for (const auto & segment : merge.segments) {
+            last_ordinal += static_cast<DocumentOrdinal>(segment->GetDocumentCount());
+        }
+        merge.removed_ordinals = GetRemovedOrdinals(first_ordinal, last_ordinal);
+        for (DocumentOrdinal & ordinal : merge.removed_ordinals) {
+            ordinal -= first_ordinal;
+        }
+        return merge;
+    };
+    DocumentOrdinal first_ordinal = 0;
+    for (size_t first = 0; first + MERGE_FACTOR <= segments_.size(); ++first) {
+        const size_t tier = get_tier(segments_[first]->GetDocumentCount());
+        const bool same_tier = all_of(segments_.begin() + first + 1, segments_.begin() + first + MERGE_FACTOR,
+            [&get_tier, tier](const auto & segment) {
+                return get_tier(segment->GetDocumentCount()) == tier;
+            });
+        if (same_tier) {
+            return make_merge(first, first + MERGE_FACTOR, first_ordinal);
+        }
+        first_ordinal += static_cast<DocumentOrdinal>(segments_[first]->GetDocumentCount());
+    }
+    first_ordinal = 0;
+    for (size_t i = 0; i < segments_.size(); ++i) {
+        const size_t document_count = segments_[i]->GetDocumentCount();
+        const auto last_ordinal = static_cast<DocumentOrdinal>(first_ordinal + document_count);
+        const size_t removed_count = removed_documents_.CountInRange(first_ordinal, last_ordinal);
+        if (removed_count > 0 && removed_count * COMPACTION_DIVISOR >= document_count) {
+            return make_merge(i, i + 1, first_ordinal);
+        }
+        first_ordinal = last_ordinal;
+    }
+    return nullopt;
+}
+
+void SearchIndex::ReplaceSegments(const SegmentMerge& merge, shared_ptr<const IndexSegment> merged) {
+    const auto first = find(segments_.begin(), segments_.end(), merge.segments.front());
+    if (first == segments_.end() || segments_.end() - first < static_cast<ptrdiff_t>(merge.segments.size())
+        || !equal(merge.segments.begin(), merge.segments.end(), first)) {
+        throw logic_error("ReplaceSegments: segments are not in the index");
+    }
+    DocumentOrdinal first_ordinal = 0;
+    for (auto it = segments_.begin(); it != first; ++it) {
+        first_ordinal += static_cast<DocumentOrdinal>((*it)->GetDocumentCount());
+    }
+    for (const auto & segment : merge.segments) {
+        segment_document_count_ -= segment->GetDocumentCount();
+    }
+    segment_document_count_ += merged->GetDocumentCount();
+    // вычищенные документы больше не нужно пропускать при поиске, а их номера
+    // освобождаются
+    vector<DocumentOrdinal> removed_ordinals = merge.removed_ordinals;
+    for (DocumentOrdinal & ordinal : removed_ordinals) {
+        ordinal += first_ordinal;
+        removed_documents_.Remove(ordinal);
+    }
+    segment_removed_count_ -= removed_ordinals.size();
+    *first = move(merged);
+    segments_.erase(first + 1, first + merge.segments.size());
+    RenumberDocuments(removed_ordinals);
+
+    vector<TermId> dead_terms;
+    for (const auto & segment : merge.segments) {
+        for (size_t i = 0; i < segment->GetTermCount(); ++i) {
+            const TermId term_id = segment->GetTerms()[i].term_id;
+            if (document_freqs_[term_id] == 0) {
+                dead_terms.push_back(term_id);
+            }
+        }
+    }
+    EraseDeadTerms(move(dead_terms));
+}
+
+vector<DocumentOrdinal> SearchIndex::GetRemovedOrdinals(DocumentOrdinal first, DocumentOrdinal last) const {
+    vector<DocumentOrdinal> ordinals;
+    for (DocumentOrdinal ordinal = removed_documents_.NextAtLeast(first);
+         ordinal < last;
+         ordinal = removed_documents_.NextAtLeast(ordinal + 1)) {
+        ordinals.push_back(ordinal);
+    }
+    return ordinals;
+}
+
+void SearchIndex::RenumberDocuments(const vector<DocumentOrdinal>& removed_ordinals) {
+    if (removed_ordinals.empty()) {
+        return;
+    }
+    // новый номер документа - старый минус число освобождённых номеров перед ним
+    auto renumber = [&removed_ordinals](DocumentOrdinal ordinal) {
+        const auto removed_before = lower_bound(removed_ordinals.begin(), removed_ordinals.end(), ordinal)
+            - removed_ordinals.begin();
+        return ordinal - static_cast<DocumentOrdinal>(removed_before);
+    };
+    const DocumentOrdinal first = removed_ordinals.front();
+
+    // документы ищутся по колонке id, пока она не сжата; у повторно
+    // добавленного id номер уже другой
+    for (DocumentOrdinal ordinal = first; ordinal < document_ids_.size(); ++ordinal) {
+        const auto it = document_ordinals_.find(document_ids_[ordinal]);
+        if (it != document_ordinals_.end() && it->second == ordinal) {
+            it->second = renumber(ordinal);
+        }
+    }
+    auto renumber_bitmap = [first, &renumber](DocumentBitmap & bitmap) {
+        vector<DocumentOrdinal> ordinals;
+        for (DocumentOrdinal ordinal = bitmap.NextAtLeast(first);
+             ordinal != NO_DOCUMENT;
+             ordinal = bitmap.NextAtLeast(ordinal + 1)) {
+            ordinals.push_back(ordinal);
+        }
+        for (const DocumentOrdinal ordinal : ordinals) {
+            bitmap.Remove(ordinal);
+        }
+        for (const DocumentOrdinal ordinal : ordinals) {
+            bitmap.Add(renumber(ordinal));
+        }
+    };
+    for (DocumentBitmap & status_documents : status_documents_) {
+        renumber_bitmap(status_documents);
+    }
+    renumber_bitmap(removed_documents_);
+
+    EraseOrdinals(document_ids_, removed_ordinals);
+    EraseOrdinals(document_ratings_, removed_ordinals);
+    EraseOrdinals(document_statuses_, removed_ordinals);
+    forward_index_.RemoveOrdinals(removed_ordinals);
+
+    const auto buffer_shift = static_cast<DocumentOrdinal>(
+        lower_bound(removed_ordinals.begin(), removed_ordinals.end(), buffer_first_ordinal_) - removed_ordinals.begin());
+    if (buffer_shift > 0) {
+        for (const TermId term_id : GetBufferTerms()) {
+            buffer_posting_lists_[term_id].ShiftOrdinals(buffer_shift);
+        }
+        buffer_first_ordinal_ -= buffer_shift;
+    }
+}
+
+void SearchIndex::EraseDeadTerms(vector<TermId> term_ids) {
+    sort(term_ids.begin(), term_ids.end());
+    term_ids.erase(unique(term_ids.begin(), term_ids.end()), term_ids.end());
+    bool erased = false;
+    for (const TermId term_id : term_ids) {
+        if (document_freqs_[term_id] > 0 || !buffer_posting_lists_[term_id].empty()) {
+            continue;
+        }
+        const bool in_segments = any_of(segments_.begin(), segments_.end(), [term_id](const auto & segment) {
+            return segment->FindTerm(term_id) != nullptr;
+        });
+        if (!in_segments) {
+            term_dictionary_.Erase(term_id);
+            erased = true;
+        }
+    }
+    // планы запросов могли сохранить id удалённого слова
+    if (erased) {
+        ++query_generation_;
+    }
+}
+
+TermCursor SearchIndex::GetTermCursor(TermId term_id) const {
+    vector<SegmentCursor> segment_cursors;
+    DocumentOrdinal first_ordinal = 0;
+    for (const auto & segment : segments_) {
+        if (const auto* term = segment->FindTerm(term_id)) {
+            segment_cursors.emplace_back(*segment, *term, first_ordinal);
+        }
+        first_ordinal += static_cast<DocumentOrdinal>(segment->GetDocumentCount());
+    }
+    return TermCursor(move(segment_cursors), buffer_posting_lists_[term_id]);
+}
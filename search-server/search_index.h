@@ -0,0 +1,948 @@
+#pragma once
+#include "string_processing.h"
+#include "document.h"
+#include "posting_list.h"
+#include "term_dictionary.h"
+#include "top_documents.h"
+#include "score_accumulator.h"
+#include "document_bitmap.h"
+#include "index_segment.h"
+#include "forward_index.h"
+#include "query_plan.h"
+
+#include <algorithm>
+#include <array>
+#include <exception>
+#include <stdexcept>
+#include <utility>
+#include <string>
+#include <vector>
+#include <tuple>
+#include <set>
+#include <map>
+#include <memory>
+#include <optional>
+#include <execution>
+#include <typeinfo>
+#include <iterator>
+#include <type_traits>
+
+#include "thread_pool.h"
+
+const int MAX_RESULT_DOCUMENT_COUNT = 5;
+
+namespace search_engine {
+// Передаётся в FindTopDocuments вместо политики исполнения: поиск окнами
+// документов с отсечением Block-Max MaxScore. Результат совпадает с полным
+// перебором, но документы, заведомо не попадающие в топ, не оцениваются,
+// а вхождения слов, которые одни не пускают документ в топ, не перебираются.
+struct wand_policy {};
+inline constexpr wand_policy wand{};
+}
+
+using MatchedWords = std::tuple<std::vector<std::string_view>, DocumentStatus>;
+
+// Документ для пакетного добавления; text должен жить до конца добавления
+struct NewDocument {
+    int id = 0;
+    std::string_view text;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+};
+
+// Документ с отпечатком и видом множества его слов, см. ForwardIndex
+struct DocumentFingerprint {
+    int id;
+    uint64_t fingerprint;
+    DocumentTermsView terms;
+};
+
+// Обходит внешние id документов в порядке возрастания
+class DocumentIdIterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = int;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const int*;
+    using reference = const int&;
+
+    explicit DocumentIdIterator(std::map<int, DocumentOrdinal>::const_iterator it)
+        : it_(it)
+    {}
+
+    reference operator*() const {
+        return it_->first;
+    }
+
+    pointer operator->() const {
+        return &it_->first;
+    }
+
+    DocumentIdIterator& operator++() {
+        ++it_;
+        return *this;
+    }
+
+    DocumentIdIterator operator++(int) {
+        DocumentIdIterator result = *this;
+        ++it_;
+        return result;
+    }
+
+    bool operator==(const DocumentIdIterator& other) const {
+        return it_ == other.it_;
+    }
+
+    bool operator!=(const DocumentIdIterator& other) const {
+        return it_ != other.it_;
+    }
+
+private:
+    std::map<int, DocumentOrdinal>::const_iterator it_;
+};
+
+// Инвертированный индекс без синхронизации. Одновременно с чтением его
+// изменять нельзя; конкурентный доступ обеспечивает SearchServer.
+// Новые документы попадают в изменяемый буфер; заполненный буфер владелец
+// индекса превращает в неизменяемый сегмент (BuildBufferSegment + FlushBuffer),
+// а соседние сегменты одного яруса объединяет (PlanSegmentMerge + ReplaceSegments).
+// Сегменты не изменяются, поэтому их могут разделять несколько индексов.
+class SearchIndex {
+public:
+    SearchIndex() = default;
+
+    explicit SearchIndex(const std::string & stop_words);
+
+    template<class StringContainer>
+    SearchIndex(const StringContainer & container);
+
+    void SetStopWords(const std::string& text);
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+
+    // Документы пакета, разобранные PrepareDocuments: части по PART_DOCUMENT_COUNT
+    // документов со своими словарями, слова документа записаны номерами в словаре
+    // части. Разбор зависит только от стоп-слов, поэтому пакет можно добавить
+    // в любой индекс с теми же стоп-словами.
+    struct DocumentBatch {
+        struct PreparedDocument {
+            int id;
+            DocumentStatus status;
+            int rating;
+            // слова документа в words его части, по возрастанию
+            uint32_t first_word;
+            uint32_t word_count;
+            // число слов текста без стоп-слов
+            uint32_t length;
+            // ошибка разбора текста, её бросает добавление документа
+            std::exception_ptr error;
+        };
+        struct Part {
+            std::vector<std::string_view> terms;
+            // (номер слова в terms, число повторений) документов части
+            std::vector<std::pair<uint32_t, uint32_t>> words;
+        };
+
+        std::vector<PreparedDocument> documents;
+        std::vector<Part> parts;
+        bool parallel = false;
+    };
+
+    static constexpr size_t PART_DOCUMENT_COUNT = 256;
+
+    // Разбивает тексты на слова и считает TF; с parallel_policy части
+    // разбираются параллельно
+    template <typename ExecutionPolicy>
+    DocumentBatch PrepareDocuments(ExecutionPolicy&& policy, const std::vector<NewDocument>& documents) const;
+
+    // Добавляет документы пакета с номерами из [first, last) так же, как их
+    // добавили бы по одному AddDocument: на первом ошибочном документе бросает
+    // то же исключение, документы перед ним остаются добавленными.
+    // Слова каждой части попадают в словарь индекса один раз.
+    void AddDocuments(const DocumentBatch& batch, size_t first, size_t last);
+
+    template <typename ExecutionPolicy>
+    void AddDocuments(ExecutionPolicy&& policy, const std::vector<NewDocument>& documents);
+
+    template <typename ExecutionPolicy>
+    void RemoveDocument(ExecutionPolicy && policy, int document_id);
+
+    void RemoveDocument(int document_id);
+
+    // Удаляет документы пакета; id, которых нет в индексе, пропускаются.
+    // Слова всех документов группируются, и df каждого слова уменьшается
+    // один раз на пакет; с parallel_policy разные слова обрабатываются параллельно.
+    template <typename ExecutionPolicy>
+    void RemoveDocuments(ExecutionPolicy&& policy, const std::vector<int>& document_ids);
+
+    // Слова документа с их TF; пустой вид, если документа нет. Действителен
+    // до следующего изменения индекса.
+    DocumentTermsView GetDocumentTerms(int document_id) const;
+
+    // Неудалённые документы по возрастанию id; виды действительны до
+    // следующего изменения индекса
+    std::vector<DocumentFingerprint> GetDocumentFingerprints() const;
+
+    // Для совместимости: те же слова картой, построенной при вызове
+    std::map<std::string_view, double> GetWordFrequencies(int document_id) const;
+
+    // max_count ограничивает число возвращаемых документов
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+                                           DocumentStatus status = DocumentStatus::ACTUAL,
+                                           size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    template <typename Predicate>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, Predicate predicate,
+                                           size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    template <typename ExecutionPolicy, typename Predicate>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, Predicate predicate,
+                                           size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    std::vector<Document> FindTopDocuments(std::string_view raw_query,
+                                           DocumentStatus status = DocumentStatus::ACTUAL,
+                                           size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    int GetDocumentCount() const;
+
+    // Число занятых порядковых номеров: документы и удалённые документы,
+    // вхождения которых ещё не вычищены. Построение и уплотнение сегмента
+    // освобождают номера вычищенных документов, и следующие сдвигаются.
+    size_t GetOrdinalCount() const {
+        return document_ids_.size();
+    }
+
+    // Число слов в словаре. Слово без документов удаляется из словаря, когда
+    // построение или уплотнение сегмента вычищает его последнее вхождение.
+    size_t GetTermCount() const {
+        return term_dictionary_.GetTermCount();
+    }
+
+    template <typename ExecutionPolicy>
+    MatchedWords MatchDocument(ExecutionPolicy && policy, std::string_view raw_query, int document_id) const;
+
+    MatchedWords MatchDocument(std::string_view raw_query, int document_id) const;
+
+    // Разбирает запрос в plan, сохраняя память плана; на ошибочном запросе
+    // бросает invalid_argument
+    void ParseQuery(std::string_view raw_query, QueryPlan& plan) const;
+
+    // Растёт, когда тот же запрос может разобраться в другой план: у слова
+    // появился первый документ, слово удалено из словаря или изменились
+    // стоп-слова. Удаления документов его не
+    // меняют: слова без документов в плане допустимы, поиск их пропускает.
+    // Копии индекса с одной историей изменений имеют одно поколение.
+    uint64_t GetQueryGeneration() const {
+        return query_generation_;
+    }
+
+    // Растёт при каждом изменении документов или стоп-слов, то есть когда
+    // может измениться результат любого запроса
+    uint64_t GetGeneration() const {
+        return generation_;
+    }
+
+    // Поиск и сопоставление по плану ParseQuery этого индекса или копии
+    // с тем же поколением
+    template <typename ExecutionPolicy, typename Predicate>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const QueryPlan& query, Predicate predicate,
+                                           size_t max_count) const;
+
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const QueryPlan& query, DocumentStatus status,
+                                           size_t max_count) const;
+
+    template <typename ExecutionPolicy>
+    MatchedWords MatchDocument(ExecutionPolicy&& policy, const QueryPlan& query, int document_id) const;
+
+    // Результаты FindTopDocuments(seq, query, status, max_count) для каждого
+    // плана пакета. Список вхождений каждого слова пакета обходится один раз:
+    // вклады документов в релевантность раскладываются в плоские массивы,
+    // а затем каждый запрос складывает их в своём накопителе в том же
+    // порядке слов, что и одиночный поиск, поэтому результат совпадает до бита.
+    // Номера документов делятся на окна так, чтобы в окне было не больше
+    // window_posting_count вхождений слов пакета.
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(const std::vector<QueryPlan>& queries,
+                                                             DocumentStatus status, size_t max_count,
+                                                             size_t window_posting_count = MAX_BATCH_POSTING_COUNT) const;
+
+    bool HasDocument(int document_id) const {
+        return document_ordinals_.count(document_id) > 0;
+    }
+
+    DocumentIdIterator begin() const;
+    DocumentIdIterator end() const;
+
+    // Записывает индекс в файл снимка: словарь, сегменты (буфер - отдельным
+    // сегментом), прямой индекс и колонки документов. log_position - первый
+    // файл журнала с изменениями, не вошедшими в снимок.
+    void SaveSnapshot(const std::string& path, uint64_t log_position = 0) const;
+
+    // Индекс из снимка. Сегменты и строки словаря не копируются, а читаются
+    // из отображённого файла; заново строятся только хеш-таблица словаря,
+    // прямой индекс и отображение id в номера.
+    static SearchIndex OpenSnapshot(const SnapshotReader& reader);
+
+    // log_position, с которым записан снимок
+    static uint64_t GetSnapshotLogPosition(const SnapshotReader& reader);
+
+    // столько вхождений пакетный поиск раскладывает за раз, чтобы массивы
+    // вкладов не росли с размером индекса
+    static constexpr size_t MAX_BATCH_POSTING_COUNT = size_t{1} << 21;
+    // столько документов буфер накапливает перед превращением в сегмент
+    static constexpr size_t BUFFER_DOCUMENT_COUNT = 1024;
+    // столько соседних сегментов одного яруса объединяются в один
+    static constexpr size_t MERGE_FACTOR = 4;
+    // сегмент переписывается без удалённых документов, когда их доля
+    // достигает 1 / COMPACTION_DIVISOR
+    static constexpr size_t COMPACTION_DIVISOR = 4;
+    // столько номеров документов в окне поиска с отсечением
+    static constexpr size_t MAX_SCORE_WINDOW_SIZE = 2048;
+
+    bool IsBufferFull() const;
+
+    // Сколько документов ещё поместится в буфер до его заполнения
+    size_t GetBufferFreeCount() const;
+
+    std::shared_ptr<const IndexSegment> BuildBufferSegment() const;
+
+    // Заменяет буфер сегментом, построенным BuildBufferSegment этого же состояния
+    void FlushBuffer(std::shared_ptr<const IndexSegment> segment);
+
+    struct SegmentMerge {
+        std::vector<std::shared_ptr<const IndexSegment>> segments;
+        // удалённые документы объединяемых сегментов, номера относительно
+        // начала первого из них
+        std::vector<DocumentOrdinal> removed_ordinals;
+    };
+
+    // Ярус сегмента - целая часть логарифма по основанию MERGE_FACTOR от числа
+    // его документов, делённого на BUFFER_DOCUMENT_COUNT. Возвращает
+    // MERGE_FACTOR соседних сегментов одного яруса, иначе один сегмент
+    // с большой долей удалённых документов для уплотнения, иначе nullopt.
+    std::optional<SegmentMerge> PlanSegmentMerge() const;
+
+    // Доля удалённых документов в сегментах достигла порога уплотнения
+    bool NeedsCompaction() const {
+        return segment_removed_count_ > 0 && segment_removed_count_ * COMPACTION_DIVISOR >= segment_document_count_;
+    }
+
+    // Число удалённых документов, вхождения которых ещё хранятся в индексе
+    size_t GetTombstoneCount() const {
+        return removed_documents_.size();
+    }
+
+    // Заменяет сегменты из merge объединённым; сегменты, добавленные после
+    // планирования, сохраняются
+    void ReplaceSegments(const SegmentMerge& merge, std::shared_ptr<const IndexSegment> merged);
+
+    size_t GetSegmentCount() const {
+        return segments_.size();
+    }
+
+private:
+
+    // Предикат отбора по статусу. Поиск узнаёт его по типу и вместо вызова
+    // для каждого документа пересекает списки вхождений с множеством статуса.
+    struct StatusPredicate {
+        DocumentStatus status;
+
+        bool operator()(int, DocumentStatus document_status, int) const {
+            return document_status == status;
+        }
+    };
+
+    static constexpr size_t STATUS_COUNT = static_cast<size_t>(DocumentStatus::REMOVED) + 1;
+
+    std::set<std::string, std::less<>> stop_words_;
+    TermDictionary term_dictionary_;
+    // см. GetGeneration и GetQueryGeneration
+    uint64_t generation_ = 0;
+    uint64_t query_generation_ = 0;
+    // неизменяемые сегменты, по порядку покрывающие номера [0, buffer_first_ordinal_);
+    // первый номер сегмента - сумма GetDocumentCount предыдущих
+    std::vector<std::shared_ptr<const IndexSegment>> segments_;
+    // списки вхождений документов буфера, индексируются TermId
+    std::vector<PostingList> buffer_posting_lists_;
+    // слова с непустыми списками в буфере (возможны повторы)
+    std::vector<TermId> buffer_terms_;
+    DocumentOrdinal buffer_first_ordinal_ = 0;
+    // число слов документов буфера, по нему сегмент восстанавливает TF
+    std::vector<uint32_t> buffer_document_lengths_;
+    // документы сегментов и удалённые из них, но ещё не вычищенные
+    size_t segment_document_count_ = 0;
+    size_t segment_removed_count_ = 0;
+    // число неудалённых документов со словом
+    std::vector<uint32_t> document_freqs_;
+    // IDF = log(N / df) = log(N) - log(df): логарифмы обновляются при изменении
+    // числа документов и df слова, поиск только читает таблицу
+    double log_document_count_ = 0.0;
+    std::vector<double> log_document_freqs_;
+    // внешний id -> порядковый номер документа; новый документ получает номер
+    // после всех занятых, поэтому списки вхождений растут только с конца
+    std::map<int, DocumentOrdinal> document_ordinals_;
+    // колонки данных документов, индексируются порядковым номером
+    std::vector<int> document_ids_;
+    std::vector<int> document_ratings_;
+    std::vector<DocumentStatus> document_statuses_;
+    ForwardIndex forward_index_;
+    // номера неудалённых документов каждого статуса
+    std::array<DocumentBitmap, STATUS_COUNT> status_documents_;
+    // удалённые документы, вхождения которых ещё хранятся: поиск их пропускает,
+    // а построение и объединение сегментов вычищает
+    DocumentBitmap removed_documents_;
+    // снимок, из которого открыт индекс: в нём лежат строки словаря
+    std::shared_ptr<const MappedFile> snapshot_file_;
+
+    bool IsStopWord(std::string_view word) const;
+
+    // Заменяет содержимое words словами text без стоп-слов; бросает
+    // invalid_argument, если в тексте есть управляющие символы
+    void SplitIntoWordsNoStop(std::string_view text, std::vector<std::string_view>& words) const;
+
+    static int ComputeAverageRating(const std::vector<int>& ratings);
+
+    // Помечает документ удалённым; df его слов меняет вызывающий
+    void MarkDocumentRemoved(std::map<int, DocumentOrdinal>::iterator iterator);
+
+    // Бросает invalid_argument, если документ с таким id нельзя добавить
+    void CheckNewDocumentId(int document_id) const;
+
+    // Разбирает документы части part пакета
+    void PrepareDocumentPart(const std::vector<NewDocument>& documents, size_t part, DocumentBatch& batch) const;
+
+    struct QueryWord {
+        std::string_view data;
+        bool is_minus;
+        bool is_stop;
+    };
+
+    QueryWord ParseQueryWord(std::string_view text, bool has_special_symbols) const;
+
+    // Номер документа для MatchDocument; бросает out_of_range, если его нет
+    DocumentOrdinal GetMatchOrdinal(int document_id) const;
+
+    MatchedWords MatchOrdinal(const QueryPlan& query, DocumentOrdinal ordinal) const;
+
+    double GetInverseDocumentFreq(TermId term_id) const {
+        if (document_freqs_[term_id] == 0) {
+            return 0.0;
+        }
+        return log_document_count_ - log_document_freqs_[term_id];
+    }
+
+    void UpdateDocumentFreq(TermId term_id);
+
+    void UpdateDocumentCount();
+
+    // Курсор по вхождениям слова во все сегменты и буфер
+    TermCursor GetTermCursor(TermId term_id) const;
+
+    // Удалённые документы из [first, last) по возрастанию
+    std::vector<DocumentOrdinal> GetRemovedOrdinals(DocumentOrdinal first, DocumentOrdinal last) const;
+
+    // Отсортированные id слов с непустыми списками в буфере
+    std::vector<TermId> GetBufferTerms() const;
+
+    // Освобождает номера вычищенных документов removed_ordinals (отсортированы):
+    // номера следующих документов уменьшаются на число освобождённых перед ними
+    void RenumberDocuments(const std::vector<DocumentOrdinal>& removed_ordinals);
+
+    // Удаляет из словаря слова из term_ids без документов, вхождений которых
+    // не осталось ни в сегментах, ни в буфере
+    void EraseDeadTerms(std::vector<TermId> term_ids);
+
+    bool IsRemoved(DocumentOrdinal ordinal) const {
+        return !removed_documents_.empty() && removed_documents_.Contains(ordinal);
+    }
+
+    // Множество, которым ограничен поиск с этим предикатом, или nullptr,
+    // если ограничения нет либо под него подходят все документы
+    template<typename Predicate>
+    const DocumentBitmap* GetFilterDocuments(const Predicate& predicate) const;
+
+    // Отбирают найденные документы в top_documents
+    template<typename Predicate>
+    void FindAllDocuments(const QueryPlan& query,
+                          Predicate predicate,
+                          TopDocumentsCollector& top_documents) const;
+
+    template<typename Predicate>
+    std::vector<Document> FindTopDocumentsWand(const QueryPlan& query,
+                                               Predicate predicate,
+                                               size_t max_count) const;
+
+    template<typename Predicate>
+    void FindAllDocuments(std::execution::parallel_policy,
+                          const QueryPlan& query,
+                          Predicate predicate,
+                          TopDocumentsCollector& top_documents) const;
+
+    template<typename Predicate>
+    void FindAllDocuments(std::execution::sequenced_policy,
+                          const QueryPlan& query,
+                          Predicate predicate,
+                          TopDocumentsCollector& top_documents) const;
+
+    // Оценивает документы с номерами из [first, last)
+    template<typename Predicate>
+    void FindDocumentsInRange(const QueryPlan& query,
+                              Predicate& predicate,
+                              DocumentOrdinal first,
+                              DocumentOrdinal last,
+                              TopDocumentsCollector& top_documents) const;
+
+    // меньше этого числа вхождений параллельный поиск не окупает запуск потоков
+    static constexpr size_t MIN_PARALLEL_POSTING_COUNT = 4096;
+};
+
+template<class StringContainer>
+SearchIndex::SearchIndex(const StringContainer & container) {
+    for (const auto & value : container) {
+        SetStopWords(value);
+    }
+}
+
+template <typename ExecutionPolicy>
+SearchIndex::DocumentBatch SearchIndex::PrepareDocuments(ExecutionPolicy&&, const std::vector<NewDocument>& documents) const {
+    DocumentBatch batch;
+    batch.documents.resize(documents.size());
+    batch.parts.resize((documents.size() + PART_DOCUMENT_COUNT - 1) / PART_DOCUMENT_COUNT);
+    if constexpr (std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::parallel_policy>) {
+        batch.parallel = true;
+        GetThreadPool().ParallelFor(batch.parts.size(), [this, &documents, &batch](size_t part) {
+            PrepareDocumentPart(documents, part, batch);
+        });
+    } else {
+        for (size_t part = 0; part < batch.parts.size(); ++part) {
+            PrepareDocumentPart(documents, part, batch);
+        }
+    }
+    return batch;
+}
+
+template <typename ExecutionPolicy>
+void SearchIndex::AddDocuments(ExecutionPolicy&& policy, const std::vector<NewDocument>& documents) {
+    AddDocuments(PrepareDocuments(policy, documents), 0, documents.size());
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> SearchIndex::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+                                                     DocumentStatus status, size_t max_count) const {
+    return FindTopDocuments(policy, raw_query, StatusPredicate{status}, max_count);
+}
+
+template <typename Predicate>
+std::vector<Document> SearchIndex::FindTopDocuments(std::string_view raw_query, Predicate predicate,
+                                                     size_t max_count) const {
+    return FindTopDocuments(std::execution::seq, raw_query, predicate, max_count);
+}
+
+template <typename ExecutionPolicy, typename Predicate>
+std::vector<Document> SearchIndex::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, Predicate predicate,
+                                                     size_t max_count) const {
+    QueryPlan query;
+    ParseQuery(raw_query, query);
+    return FindTopDocuments(policy, query, predicate, max_count);
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> SearchIndex::FindTopDocuments(ExecutionPolicy&& policy, const QueryPlan& query, DocumentStatus status,
+                                                     size_t max_count) const {
+    return FindTopDocuments(policy, query, StatusPredicate{status}, max_count);
+}
+
+template <typename ExecutionPolicy, typename Predicate>
+std::vector<Document> SearchIndex::FindTopDocuments(ExecutionPolicy&& policy, const QueryPlan& query, Predicate predicate,
+                                                     size_t max_count) const {
+    const DocumentBitmap* filter_documents = GetFilterDocuments(predicate);
+    if (filter_documents && filter_documents->empty()) {
+        return {};
+    }
+    if constexpr (std::is_same_v<std::decay_t<ExecutionPolicy>, search_engine::wand_policy>) {
+        return FindTopDocumentsWand(query, predicate, max_count);
+    } else {
+        TopDocumentsCollector top_documents(max_count);
+        FindAllDocuments(policy, query, predicate, top_documents);
+        return top_documents.Extract();
+    }
+}
+
+template<typename Predicate>
+void SearchIndex::FindAllDocuments(const QueryPlan& query, Predicate predicate, TopDocumentsCollector& top_documents) const {
+    FindAllDocuments(std::execution::seq, query, predicate, top_documents);
+}
+
+template<typename Predicate>
+void SearchIndex::FindAllDocuments(std::execution::sequenced_policy, const QueryPlan& query, Predicate predicate,
+                                    TopDocumentsCollector& top_documents) const {
+    FindDocumentsInRange(query, predicate, 0, static_cast<DocumentOrdinal>(document_ids_.size()), top_documents);
+}
+
+template<typename Predicate>
+void SearchIndex::FindAllDocuments(std::execution::parallel_policy, const QueryPlan& query, Predicate predicate,
+                                    TopDocumentsCollector& top_documents) const {
+    size_t posting_count = 0;
+    for (const TermId term_id : query.plus_words) {
+        posting_count += document_freqs_[term_id];
+    }
+    ThreadPool & thread_pool = GetThreadPool();
+    const size_t part_count = std::min(thread_pool.GetConcurrency(), posting_count / MIN_PARALLEL_POSTING_COUNT);
+    if (part_count <= 1) {
+        FindAllDocuments(std::execution::seq, query, predicate, top_documents);
+        return;
+    }
+
+    // каждый поток оценивает свой диапазон номеров документов в собственном
+    // накопителе и отбирает свой топ, общих данных на запись нет
+    const size_t document_count = document_ids_.size();
+    std::vector<TopDocumentsCollector> part_top_documents(part_count, TopDocumentsCollector(top_documents.GetMaxCount()));
+    thread_pool.ParallelFor(part_count, [&](size_t part) {
+        const auto first = static_cast<DocumentOrdinal>(document_count * part / part_count);
+        const auto last = static_cast<DocumentOrdinal>(document_count * (part + 1) / part_count);
+        FindDocumentsInRange(query, predicate, first, last, part_top_documents[part]);
+    });
+    for (auto & part_top : part_top_documents) {
+        for (const Document & document : part_top.Extract()) {
+            top_documents.Push(document);
+        }
+    }
+}
+
+template<typename Predicate>
+void SearchIndex::FindDocumentsInRange(const QueryPlan& query, Predicate& predicate,
+                                        DocumentOrdinal first, DocumentOrdinal last,
+                                        TopDocumentsCollector& top_documents) const {
+    constexpr bool is_status_predicate = std::is_same_v<Predicate, StatusPredicate>;
+    const DocumentBitmap* filter_documents = GetFilterDocuments(predicate);
+    // накопитель индексируется смещением от first
+    const auto accumulator = ScoreAccumulator::Acquire(last - first);
+    auto for_each_in_range = [first, last](TermCursor cursor, const DocumentBitmap* filter, auto function) {
+        cursor.SkipTo(first);
+        if (!filter) {
+            cursor.ForEachBefore(last, [first, &function](DocumentOrdinal ordinal, double term_freq) {
+                function(term_freq, ordinal - first);
+            });
+            return;
+        }
+        // пересечение: каждый раз переходим к следующему документу, который есть в обоих множествах
+        for (DocumentOrdinal ordinal = cursor.GetOrdinal(); ordinal < last; ordinal = cursor.GetOrdinal()) {
+            const DocumentOrdinal member = filter->NextAtLeast(ordinal);
+            if (member >= last) {
+                break;
+            }
+            if (member != ordinal) {
+                cursor.SkipTo(member);
+                continue;
+            }
+            function(cursor.GetTermFreq(), ordinal - first);
+            cursor.Next();
+        }
+    };
+
+    for (const TermId term_id : query.minus_words) {
+        for_each_in_range(GetTermCursor(term_id), nullptr, [&accumulator](double, DocumentOrdinal offset) {
+            accumulator->Exclude(offset);
+        });
+    }
+
+    for (const TermId term_id : query.plus_words) {
+        if (document_freqs_[term_id] == 0) {
+            continue;
+        }
+        const double inverse_document_freq = GetInverseDocumentFreq(term_id);
+        for_each_in_range(GetTermCursor(term_id), filter_documents, [&accumulator, inverse_document_freq](double term_freq, DocumentOrdinal offset) {
+            if (!accumulator->IsExcluded(offset)) {
+                accumulator->Add(offset, term_freq * inverse_document_freq);
+            }
+        });
+    }
+
+    accumulator->ForEach([this, first, &predicate, &top_documents](DocumentOrdinal offset, double relevance) {
+        const DocumentOrdinal ordinal = first + offset;
+        if (IsRemoved(ordinal)) {
+            return;
+        }
+        if ( is_status_predicate
+             || predicate(document_ids_[ordinal], document_statuses_[ordinal], document_ratings_[ordinal]) ) {
+            top_documents.Push({
+                document_ids_[ordinal],
+                relevance,
+                document_ratings_[ordinal]
+            });
+        }
+    });
+}
+
+template<typename Predicate>
+std::vector<Document> SearchIndex::FindTopDocumentsWand(const QueryPlan& query, Predicate predicate, size_t max_count) const {
+    struct ScoredCursor {
+        TermCursor cursor;
+        TermId term_id;
+        double inverse_document_freq;
+        double max_score;
+        // максимум оценки в текущем окне
+        double window_max_score = 0.0;
+    };
+    std::vector<ScoredCursor> terms;
+    terms.reserve(query.plus_words.size());
+    for (const TermId term_id : query.plus_words) {
+        if (document_freqs_[term_id] > 0) {
+            const double inverse_document_freq = GetInverseDocumentFreq(term_id);
+            TermCursor cursor = GetTermCursor(term_id);
+            const double max_score = cursor.GetMaxTermFreq() * inverse_document_freq;
+            terms.push_back({std::move(cursor), term_id, inverse_document_freq, max_score});
+        }
+    }
+    TopDocumentsCollector top_documents(max_count);
+    if (terms.empty() || max_count == 0) {
+        return top_documents.Extract();
+    }
+    std::vector<TermCursor> minus_cursors;
+    minus_cursors.reserve(query.minus_words.size());
+    for (const TermId term_id : query.minus_words) {
+        minus_cursors.push_back(GetTermCursor(term_id));
+    }
+
+    constexpr bool is_status_predicate = std::is_same_v<Predicate, StatusPredicate>;
+    const DocumentBitmap* filter_documents = GetFilterDocuments(predicate);
+
+    // документ может попасть в топ, только если его оценка сверху не ниже
+    // худшего из отобранных; запас в 2 EPS покрывает сравнение с допуском
+    auto can_enter = [&top_documents](double upper_bound) {
+        return !top_documents.IsFull()
+            || upper_bound >= top_documents.GetWorst().relevance * (1.0 - 2.0 * RELEVANCE_CMP_EPSILON);
+    };
+    // Слова упорядочиваются по возрастанию максимальной оценки. Слова префикса,
+    // сумма оценок которого не пускает документ в топ, необязательные:
+    // документ только с ними в топ не попадёт, поэтому документы перебирают
+    // курсоры обязательных слов, а необязательные лишь досдвигаются к ним.
+    // Возвращает длину префикса; prefix_scores[i] - сумма оценок первых i слов.
+    auto count_optional = [&can_enter](const std::vector<double>& prefix_scores) {
+        size_t optional_count = 0;
+        while (optional_count + 1 < prefix_scores.size() && !can_enter(prefix_scores[optional_count + 1])) {
+            ++optional_count;
+        }
+        return optional_count;
+    };
+    auto partition = [&count_optional](std::vector<ScoredCursor*>& by_score, std::vector<double>& prefix_scores,
+                                       double ScoredCursor::* score) {
+        std::stable_sort(by_score.begin(), by_score.end(), [score](const ScoredCursor* lhs, const ScoredCursor* rhs) {
+            return lhs->*score < rhs->*score;
+        });
+        prefix_scores.assign(by_score.size() + 1, 0.0);
+        for (size_t i = 0; i < by_score.size(); ++i) {
+            prefix_scores[i + 1] = prefix_scores[i] + by_score[i]->*score;
+        }
+        return count_optional(prefix_scores);
+    };
+
+    std::vector<ScoredCursor*> by_score;
+    by_score.reserve(terms.size());
+    for (ScoredCursor & term : terms) {
+        by_score.push_back(&term);
+    }
+    std::vector<double> prefix_scores;
+    partition(by_score, prefix_scores, &ScoredCursor::max_score);
+    std::vector<ScoredCursor*> window_terms = by_score;
+    std::vector<double> window_prefix_scores;
+
+    // Документы перебираются окнами по MAX_SCORE_WINDOW_SIZE номеров. В каждом
+    // окне слова заново делятся на обязательные и необязательные по максимумам
+    // блоков, лежащих в окне; обязательные оцениваются подряд в накопителе,
+    // как при полном переборе, необязательные досдвигаются только к документам,
+    // которые с ними ещё могут попасть в топ. Окно, где все слова необязательны,
+    // пропускается без распаковки.
+    const auto accumulator = ScoreAccumulator::Acquire(MAX_SCORE_WINDOW_SIZE);
+    DocumentOrdinal window_first = 0;
+    for (;;) {
+        // по максимумам слов во всём индексе: с порогом растёт и этот префикс
+        const size_t optional_count = count_optional(prefix_scores);
+        DocumentOrdinal first = NO_DOCUMENT;
+        for (size_t i = optional_count; i < by_score.size(); ++i) {
+            TermCursor & cursor = by_score[i]->cursor;
+            if (cursor.GetOrdinal() < window_first) {
+                cursor.SkipTo(window_first);
+            }
+            first = std::min(first, cursor.GetOrdinal());
+        }
+        if (first != NO_DOCUMENT && filter_documents) {
+            first = filter_documents->NextAtLeast(first);
+        }
+        if (first == NO_DOCUMENT) {
+            break;
+        }
+        const DocumentOrdinal last = first < NO_DOCUMENT - MAX_SCORE_WINDOW_SIZE
+            ? static_cast<DocumentOrdinal>(first + MAX_SCORE_WINDOW_SIZE)
+            : NO_DOCUMENT;
+        window_first = last;
+
+        for (ScoredCursor & term : terms) {
+            double max_term_freq = 0.0;
+            for (DocumentOrdinal target = std::max(first, term.cursor.GetOrdinal()); target < last;) {
+                DocumentOrdinal block_last;
+                max_term_freq = std::max(max_term_freq, term.cursor.GetBlockMaxTermFreq(target, block_last));
+                if (block_last == NO_DOCUMENT) {
+                    break;
+                }
+                target = block_last + 1;
+            }
+            term.window_max_score = max_term_freq * term.inverse_document_freq;
+        }
+        const size_t window_optional_count = partition(window_terms, window_prefix_scores, &ScoredCursor::window_max_score);
+        if (window_optional_count == window_terms.size()) {
+            continue;
+        }
+
+        accumulator->Clear();
+        for (size_t i = window_optional_count; i < window_terms.size(); ++i) {
+            ScoredCursor & term = *window_terms[i];
+            term.cursor.SkipTo(first);
+            const double inverse_document_freq = term.inverse_document_freq;
+            term.cursor.ForEachBefore(last, [&accumulator, first, inverse_document_freq](DocumentOrdinal ordinal, double term_freq) {
+                accumulator->Add(ordinal - first, term_freq * inverse_document_freq);
+            });
+        }
+        accumulator->ForEach([&](DocumentOrdinal offset, double score) {
+            const DocumentOrdinal ordinal = first + offset;
+            if (!can_enter(score + window_prefix_scores[window_optional_count])) {
+                return;
+            }
+            // документы другого статуса пропускаем, не оценивая
+            if ((filter_documents && !filter_documents->Contains(ordinal)) || IsRemoved(ordinal)) {
+                return;
+            }
+            for (TermCursor & minus_cursor : minus_cursors) {
+                minus_cursor.SkipTo(ordinal);
+                if (minus_cursor.GetOrdinal() == ordinal) {
+                    return;
+                }
+            }
+            if (!is_status_predicate
+                && !predicate(document_ids_[ordinal], document_statuses_[ordinal], document_ratings_[ordinal])) {
+                return;
+            }
+            // необязательные курсоры сдвигаем от самого весомого, пока
+            // документ ещё может попасть в топ
+            for (size_t i = window_optional_count; i-- > 0;) {
+                if (!can_enter(score + window_prefix_scores[i + 1])) {
+                    return;
+                }
+                ScoredCursor & term = *window_terms[i];
+                term.cursor.SkipTo(ordinal);
+                if (term.cursor.GetOrdinal() == ordinal) {
+                    score += term.cursor.GetTermFreq() * term.inverse_document_freq;
+                }
+            }
+            if (!can_enter(score)) {
+                return;
+            }
+            // точную релевантность суммируем в порядке запроса, как полный перебор
+            const DocumentTermsView document_terms = forward_index_.GetTerms(ordinal);
+            double relevance = 0.0;
+            for (const ScoredCursor & term : terms) {
+                if (const DocumentTerm* document_term = document_terms.Find(term.term_id)) {
+                    relevance += document_term->term_freq * term.inverse_document_freq;
+                }
+            }
+            top_documents.Push({document_ids_[ordinal], relevance, document_ratings_[ordinal]});
+        });
+    }
+    return top_documents.Extract();
+}
+
+template <typename ExecutionPolicy>
+void SearchIndex::RemoveDocument(ExecutionPolicy && policy, int document_id) {
+    auto iterator = document_ordinals_.find(document_id);
+    if (iterator == document_ordinals_.end()) {
+        return;
+    }
+    std::vector<TermId> to_delete;
+    for (const DocumentTerm & term : forward_index_.GetTerms(iterator->second)) {
+        to_delete.push_back(term.term_id);
+    }
+    // вхождения не трогаем: документ помечается удалённым, а вычищается при
+    // построении или уплотнении сегмента. Меняются только df его слов.
+    auto erase_posting = [this](TermId term_id) {
+        --document_freqs_[term_id];
+        UpdateDocumentFreq(term_id);
+    };
+    if constexpr (std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::parallel_policy>) {
+        GetThreadPool().ParallelFor(to_delete.size(), [&to_delete, &erase_posting](size_t i) {
+            erase_posting(to_delete[i]);
+        });
+    } else {
+        std::for_each(policy, to_delete.begin(), to_delete.end(), erase_posting);
+    }
+    MarkDocumentRemoved(iterator);
+    UpdateDocumentCount();
+}
+
+template <typename ExecutionPolicy>
+void SearchIndex::RemoveDocuments(ExecutionPolicy&&, const std::vector<int>& document_ids) {
+    // слова удаляемых документов; после сортировки повторы слова идут подряд
+    std::vector<TermId> terms;
+    for (const int document_id : document_ids) {
+        const auto iterator = document_ordinals_.find(document_id);
+        if (iterator == document_ordinals_.end()) {
+            continue;
+        }
+        for (const DocumentTerm & term : forward_index_.GetTerms(iterator->second)) {
+            terms.push_back(term.term_id);
+        }
+        MarkDocumentRemoved(iterator);
+    }
+    // сортировка последовательная: слов удаляемых документов немного, а
+    // параллельные алгоритмы стандартной библиотеки работают в обход пула потоков
+    std::sort(terms.begin(), terms.end());
+    std::vector<size_t> group_starts;
+    for (size_t i = 0; i < terms.size(); ++i) {
+        if (i == 0 || terms[i] != terms[i - 1]) {
+            group_starts.push_back(i);
+        }
+    }
+    group_starts.push_back(terms.size());
+
+    // каждая группа - своё слово, поэтому группы не пересекаются по данным
+    auto update_group = [this, &terms, &group_starts](size_t group) {
+        const TermId term_id = terms[group_starts[group]];
+        document_freqs_[term_id] -= static_cast<uint32_t>(group_starts[group + 1] - group_starts[group]);
+        UpdateDocumentFreq(term_id);
+    };
+    if constexpr (std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::parallel_policy>) {
+        GetThreadPool().ParallelFor(group_starts.size() - 1, update_group);
+    } else {
+        for (size_t group = 0; group + 1 < group_starts.size(); ++group) {
+            update_group(group);
+        }
+    }
+    UpdateDocumentCount();
+}
+
+template<typename Predicate>
+const DocumentBitmap* SearchIndex::GetFilterDocuments(const Predicate& predicate) const {
+    if constexpr (std::is_same_v<Predicate, StatusPredicate>) {
+        const DocumentBitmap & documents = status_documents_[static_cast<size_t>(predicate.status)];
+        if (documents.size() == document_ordinals_.size()) {
+            return nullptr;
+        }
+        return &documents;
+    } else {
+        return nullptr;
+    }
+}
+
+template <typename ExecutionPolicy>
+MatchedWords SearchIndex::MatchDocument(ExecutionPolicy&&, std::string_view raw_query, int document_id) const {
+    // документ проверяется раньше разбора запроса
+    const DocumentOrdinal ordinal = GetMatchOrdinal(document_id);
+    QueryPlan query;
+    ParseQuery(raw_query, query);
+    return MatchOrdinal(query, ordinal);
+}
+
+template <typename ExecutionPolicy>
+MatchedWords SearchIndex::MatchDocument(ExecutionPolicy&&, const QueryPlan& query, int document_id) const {
+    return MatchOrdinal(query, GetMatchOrdinal(document_id));
+}
@@ -1,8 +1,12 @@
 #include "search_server.h"
-#include "read_input_functions.h"
-#include "string_processing.h"
-#include <cmath>
-#include <numeric>
+
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <typeinfo>
+#include <unordered_map>
 
 using namespace std;
 
@@ -11,157 +15,380 @@ SearchServer::SearchServer(const string & stop_words) {
 }
 
 void SearchServer::SetStopWords(const string& text) {
-    for (auto word : SplitIntoWords(text)) {
-        if (HasSpecialSymbols(word)) {
-            throw invalid_argument("SetStopWords: Invalid stop word='"s + string{word} + "'"s);
+    // стоп-слова перед ошибочным словом остаются добавленными, поэтому при
+    // ошибке в журнал попадают только они
+    string added_words;
+    exception_ptr error;
+    bool applied = false;
+    auto log = [&added_words](WriteAheadLog & wal) {
+        return wal.AppendSetStopWords(added_words);
+    };
+    Write(log, [&](SearchIndex & index) {
+        exception_ptr copy_error;
+        try {
+            index.SetStopWords(text);
+        } catch (const invalid_argument&) {
+            copy_error = current_exception();
+        }
+        if (!applied) {
+            applied = true;
+            error = copy_error;
+            added_words = error ? GetValidStopWords(text) : text;
+        } else if (!copy_error != !error) {
+            throw logic_error("SetStopWords: copies added different stop words");
         }
-        stop_words_.insert(string{word});
+    });
+    if (error) {
+        rethrow_exception(error);
     }
 }
 
-void SearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
-    if (document_id < 0) {
-        throw invalid_argument("AddDocument: document_id < 0");
+string SearchServer::GetValidStopWords(string_view text) {
+    string words;
+    for (const TextWord & word : WordTokenizer(text)) {
+        if (word.has_special_symbols) {
+            break;
+        }
+        if (!words.empty()) {
+            words += ' ';
+        }
+        words += word.text;
     }
-    if (documents_.count(document_id) > 0) {
-        throw invalid_argument("AddDocument: document_id=" + to_string(document_id) + " already exist");
+    return words;
+}
+
+SearchServer::~SearchServer() {
+    {
+        lock_guard lock(merge_thread_mutex_);
+        stopping_ = true;
     }
-    const vector<string_view> words = SplitIntoWordsNoStop(document);
-    const double inv_word_count = 1.0 / words.size();
-    auto & map_of_words_freq = document_to_word_freqs_[document_id];
-    for (auto word : words) {
-        std::string word_str = string{word};
-        auto it = word_to_document_freqs_.find(word_str);
-        if (it == word_to_document_freqs_.end()) {
-            auto it_out = word_to_document_freqs_.insert({word_str, {}});
-            if (it_out.second == false) {
-                continue;
-            } else {
-                it = it_out.first;
+    merge_wake_up_.notify_one();
+    if (merge_thread_.joinable()) {
+        merge_thread_.join();
+    }
+}
+
+void SearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    // обе копии получают один и тот же сегмент, построенный при первом применении
+    shared_ptr<const IndexSegment> segment;
+    auto log = [&](WriteAheadLog & wal) {
+        return wal.AppendAddDocument(document_id, document, status, ratings);
+    };
+    Write(log, [&](SearchIndex & index) {
+        index.AddDocument(document_id, document, status, ratings);
+        if (index.IsBufferFull()) {
+            if (!segment) {
+                segment = index.BuildBufferSegment();
             }
+            index.FlushBuffer(segment);
         }
-        it->second[document_id] += inv_word_count;
-        map_of_words_freq[it->first] += inv_word_count;
+    });
+    if (segment) {
+        RequestMerge();
     }
-    documents_.emplace(document_id,
-        DocumentData{
-            ComputeAverageRating(ratings),
-            status
-        });
-    documents_indexes_.insert(document_id);
+}
+
+void SearchServer::AddDocuments(const vector<NewDocument>& documents) {
+    AddDocuments(std::execution::par, documents);
 }
 
 void SearchServer::RemoveDocument(int document_id) {
     RemoveDocument(std::execution::seq, document_id);
 }
 
-const map<string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-    const auto & doc_2_word_freqs_iter = document_to_word_freqs_.find(document_id);
-    if (doc_2_word_freqs_iter == document_to_word_freqs_.end()) {
-        static map<string_view, double> empty_map;
-        return empty_map;
-    }
-    return doc_2_word_freqs_iter->second;
+void SearchServer::RemoveDocuments(const vector<int>& document_ids) {
+    RemoveDocuments(std::execution::par, document_ids);
+}
+
+vector<DocumentTerm> SearchServer::GetDocumentTerms(int document_id) const {
+    // вид копии действителен, только пока читатель зарегистрирован
+    return Read([document_id](const SearchIndex & index) {
+        const DocumentTermsView terms = index.GetDocumentTerms(document_id);
+        return vector<DocumentTerm>(terms.begin(), terms.end());
+    });
+}
+
+map<string_view, double> SearchServer::GetWordFrequencies(int document_id) const {
+    return Read([document_id](const SearchIndex & index) {
+        return index.GetWordFrequencies(document_id);
+    });
 }
 
-std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(std::execution::seq, raw_query, status);
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+                                                     size_t max_count) const {
+    return FindTopDocuments(std::execution::seq, raw_query, status, max_count);
+}
+
+vector<vector<Document>> SearchServer::FindTopDocumentsBatch(const vector<string>& raw_queries, DocumentStatus status,
+                                                             size_t max_count) const {
+    const optional<uint64_t> tag = GetResultCacheTag<execution::sequenced_policy>(status, max_count);
+    return Read([&](const SearchIndex & index) {
+        const uint64_t generation = index.GetGeneration();
+        vector<vector<Document>> results(raw_queries.size());
+        // разные тексты запросов, не найденные в кэше результатов, и их планы
+        unordered_map<string_view, size_t> query_indexes;
+        vector<string_view> texts;
+        vector<QueryPlan> queries;
+        vector<size_t> result_query_indexes(raw_queries.size(), SIZE_MAX);
+        for (size_t i = 0; i < raw_queries.size(); ++i) {
+            const auto [it, inserted] = query_indexes.emplace(raw_queries[i], queries.size());
+            if (inserted) {
+                if (tag && result_cache_.Find(raw_queries[i], *tag, generation, results[i])) {
+                    query_indexes.erase(it);
+                    continue;
+                }
+                texts.push_back(raw_queries[i]);
+                queries.emplace_back();
+                GetQueryPlan(index, raw_queries[i], queries.back());
+            }
+            result_query_indexes[i] = it->second;
+        }
+        vector<vector<Document>> found = index.FindTopDocumentsBatch(queries, status, max_count);
+        if (tag && result_cache_.GetBudget() > 0) {
+            for (size_t i = 0; i < queries.size(); ++i) {
+                result_cache_.Insert(texts[i], *tag, generation, found[i], GetResultCacheCost(texts[i], found[i]));
+            }
+        }
+        for (size_t i = 0; i < raw_queries.size(); ++i) {
+            if (result_query_indexes[i] != SIZE_MAX) {
+                results[i] = found[result_query_indexes[i]];
+            }
+        }
+        return results;
+    });
 }
 
 int SearchServer::GetDocumentCount() const {
-    return documents_.size();
+    return Read([](const SearchIndex & index) {
+        return index.GetDocumentCount();
+    });
 }
 
 MatchedWords SearchServer::MatchDocument(string_view raw_query, int document_id) const {
     return MatchDocument(std::execution::seq, raw_query, document_id);
 }
 
-bool SearchServer::IsStopWord(string_view word) const {
-    return stop_words_.count(word) > 0;
+void SearchServer::SetQueryPlanCacheCapacity(size_t capacity) {
+    query_plan_cache_.SetBudget(capacity);
 }
 
-vector<string_view> SearchServer::SplitIntoWordsNoStop(string_view text) const {
-    vector<string_view> words;
-    for (auto word : SplitIntoWords(text)) {
-        if (HasSpecialSymbols(word)) {
-            throw invalid_argument("SplitIntoWordsNoStop: invalid symbols='"s + string{text} + "'"s);
-        }
-        if (!IsStopWord(word)) {
-            words.push_back(word);
-        }
-    }
-    return words;
+QueryPlanCache::Stats SearchServer::GetQueryPlanCacheStats() const {
+    return query_plan_cache_.GetStats();
 }
 
-int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
-    if (ratings.empty()) {
-        return 0;
+void SearchServer::GetQueryPlan(const SearchIndex& index, string_view raw_query, QueryPlan& plan) const {
+    const uint64_t generation = index.GetQueryGeneration();
+    if (query_plan_cache_.Find(raw_query, 0, generation, plan)) {
+        return;
     }
-    int rating_sum = std::accumulate(ratings.begin(), ratings.end(), 0);
-    return rating_sum / static_cast<int>(ratings.size());
+    index.ParseQuery(raw_query, plan);
+    query_plan_cache_.Insert(raw_query, 0, generation, plan, 1);
 }
 
-SearchServer::QueryWord SearchServer::ParseQueryWord(string_view text) const {
-    if (text.empty()) {
-        throw invalid_argument("ParseQueryWord: empty word"s);
-    }
-    if (HasSpecialSymbols(text)) {
-        throw invalid_argument("ParseQueryWord: invalid symbols '"s + string{text} + "'"s);
+void SearchServer::SetResultCacheBudget(size_t budget) {
+    result_cache_.SetBudget(budget);
+}
+
+ResultCache::Stats SearchServer::GetResultCacheStats() const {
+    return result_cache_.GetStats();
+}
+
+size_t SearchServer::GetResultCacheCost(string_view raw_query, const vector<Document>& documents) {
+    // запись в списке, узел хеш-таблицы, текст и документы
+    constexpr size_t ENTRY_OVERHEAD = 160;
+    return ENTRY_OVERHEAD + raw_query.size() + documents.size() * sizeof(Document);
+}
+
+DocumentIdSnapshotIterator SearchServer::begin() const {
+    return DocumentIdSnapshotIterator(Read([](const SearchIndex & index) {
+        return make_shared<const vector<int>>(index.begin(), index.end());
+    }));
+}
+
+DocumentIdSnapshotIterator SearchServer::end() const {
+    return {};
+}
+
+void SearchServer::SaveSnapshot(const string& path) const {
+    Read([&path](const SearchIndex & index) {
+        index.SaveSnapshot(path);
+    });
+}
+
+SearchServer SearchServer::OpenSnapshot(const string& path) {
+    return SearchServer(SnapshotReader(make_shared<const MappedFile>(path)));
+}
+
+SearchServer::SearchServer(const SnapshotReader& reader) {
+    OpenIndexes(reader);
+}
+
+void SearchServer::OpenIndexes(const SnapshotReader& reader) {
+    // снимок читается и проверяется один раз; вторая копия копирует готовые
+    // словарь, таблицу id и множества документов, не строя их заново
+    indexes_[0] = SearchIndex::OpenSnapshot(reader);
+    indexes_[1] = SearchIndex(indexes_[0]);
+}
+
+SearchServer SearchServer::OpenDurable(const string& directory, WriteAheadLog::Options options) {
+    return SearchServer(directory, options);
+}
+
+SearchServer::SearchServer(const string& directory, const WriteAheadLog::Options& options)
+    : durable_directory_(directory)
+{
+    const string snapshot_path = (filesystem::path(directory) / "index.snapshot").string();
+    uint64_t log_position = 0;
+    if (filesystem::exists(snapshot_path)) {
+        const SnapshotReader reader(make_shared<const MappedFile>(snapshot_path));
+        log_position = SearchIndex::GetSnapshotLogPosition(reader);
+        OpenIndexes(reader);
     }
-    QueryWord result;
-    result.is_minus = false;
-    result.is_stop = false;
-    if (text[0] == '-') {
-        result.is_minus = true;
-        if (text.size() == 1) {
-            throw invalid_argument("ParseQueryWord: empty minus word"s);
-        } else {
-            if (text[1] == '-') {
-                throw invalid_argument("ParseQueryWord: minus word contents --"s);
-            } else {
-                result.data = string{text.substr(1)};
+    ReplayLog(directory, log_position);
+    // журнал заводится после восстановления, чтобы оно само не записывалось
+    wal_ = make_unique<WriteAheadLog>(directory, options);
+}
+
+void SearchServer::ReplayLog(const string& directory, uint64_t first_segment) {
+    // подряд идущие добавления применяются пакетом
+    constexpr size_t MAX_PENDING_DOCUMENT_COUNT = 4096;
+    vector<string> texts;
+    vector<NewDocument> documents;
+    auto add_pending = [&]() {
+        for (size_t i = 0; i < documents.size(); ++i) {
+            documents[i].text = texts[i];
+        }
+        // в журнале только применившиеся изменения, поэтому ошибка здесь
+        // означает повреждённый журнал и открытие сервера прерывается
+        AddDocuments(documents);
+        texts.clear();
+        documents.clear();
+    };
+    WriteAheadLog::Replay(directory, first_segment, [&](const LogRecord & record) {
+        if (record.type == LogRecordType::ADD_DOCUMENT) {
+            texts.emplace_back(record.text);
+            documents.push_back({record.document_id, {}, record.status, record.ratings});
+            if (documents.size() == MAX_PENDING_DOCUMENT_COUNT) {
+                add_pending();
             }
+            return;
         }
+        add_pending();
+        if (record.type == LogRecordType::SET_STOP_WORDS) {
+            SetStopWords(string(record.text));
+        } else {
+            RemoveDocument(record.document_id);
+        }
+    });
+    add_pending();
+}
+
+void SearchServer::Checkpoint() {
+    if (!wal_) {
+        throw logic_error("Checkpoint: server has no write-ahead log"s);
     }
-    if (result.data.empty()) {
-        result.data = string{text};
-    }
-    result.is_stop = IsStopWord(text);
-    return result;
+    lock_guard lock(write_mutex_);
+    // всё, что записано в журнал до новой позиции, уже применено к копиям
+    const uint64_t log_position = wal_->Rotate();
+    indexes_[read_index_.load()].SaveSnapshot((filesystem::path(durable_directory_) / "index.snapshot").string(),
+                                              log_position);
+    wal_->Truncate(log_position);
 }
 
-SearchServer::Query SearchServer::ParseQuery(string_view text, bool need_sort) const {
-    Query query;
-    for (auto word : SplitIntoWords(text)) {
-        const QueryWord query_word = ParseQueryWord(word);
-        if (!query_word.is_stop) {
-            auto & ref_vector = query_word.is_minus ? query.minus_words : query.plus_words;
-            ref_vector.push_back(query_word.data);
+void SearchServer::MergeSegments() {
+    lock_guard lock(merge_mutex_);
+    for (;;) {
+        const auto merge = Read([](const SearchIndex & index) {
+            return index.PlanSegmentMerge();
+        });
+        if (!merge) {
+            return;
         }
+        // сегменты неизменяемы, поэтому объединение строится без блокировок
+        const auto merged = IndexSegment::Merge(merge->segments, merge->removed_ordinals);
+        Write([&merge, &merged](SearchIndex & index) {
+            index.ReplaceSegments(*merge, merged);
+        });
     }
-    if (need_sort) {
-        auto uniqicator = [](std::vector<std::string> & ref_vector) {
-            std::sort(ref_vector.begin(), ref_vector.end());
-            ref_vector.resize(std::distance(ref_vector.begin(),
-                std::unique(ref_vector.begin(), ref_vector.end())));
-        };
-        uniqicator(query.plus_words);
-        uniqicator(query.minus_words);
-    }
-    return query;
 }
 
-// Existence required
-double SearchServer::ComputeWordInverseDocumentFreq(const string& word) const {
-    return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+size_t SearchServer::GetSegmentCount() const {
+    return Read([](const SearchIndex & index) {
+        return index.GetSegmentCount();
+    });
 }
 
-std::set<int>::const_iterator SearchServer::begin() const {
-    return documents_indexes_.begin();
+void SearchServer::RequestMerge() {
+    {
+        lock_guard lock(merge_thread_mutex_);
+        merge_requested_ = true;
+        if (!merge_thread_.joinable()) {
+            merge_thread_ = thread([this] {
+                RunMergeThread();
+            });
+        }
+    }
+    merge_wake_up_.notify_one();
 }
 
-std::set<int>::const_iterator SearchServer::end() const {
-    return documents_indexes_.end();
+void SearchServer::RunMergeThread() {
+    unique_lock lock(merge_thread_mutex_);
+    for (;;) {
+        merge_wake_up_.wait(lock, [this] {
+            return merge_requested_ || stopping_;
+        });
+        if (stopping_) {
+            return;
+        }
+        merge_requested_ = false;
+        lock.unlock();
+        MergeSegments();
+        lock.lock();
+    }
 }
 
+void SearchServer::CheckCopiesAgree(const exception_ptr& first_error, const exception_ptr& second_error) const {
+    // исключения сравниваются по типу и тексту, копии - по поколению и числу документов
+    auto describe = [](const exception_ptr& error) -> pair<const type_info*, string> {
+        if (!error) {
+            return {nullptr, {}};
+        }
+        try {
+            rethrow_exception(error);
+        } catch (const exception& e) {
+            return {&typeid(e), e.what()};
+        } catch (...) {
+            return {&typeid(void), {}};
+        }
+    };
+    const auto first = describe(first_error);
+    const auto second = describe(second_error);
+    const bool same_error = first.first == second.first
+        || (first.first && second.first && *first.first == *second.first);
+    if (!same_error || first.second != second.second
+        || indexes_[0].GetGeneration() != indexes_[1].GetGeneration()
+        || indexes_[0].GetDocumentCount() != indexes_[1].GetDocumentCount()) {
+        cerr << "SearchServer: index copies diverged, update failed on one copy only"s << endl;
+        terminate();
+    }
+}
 
+void SearchServer::WaitForReaders() {
+    auto wait_for = [this](size_t version) {
+        for (const ReaderCounter & counter : readers_[version]) {
+            while (counter.count.load() != 0) {
+                this_thread::yield();
+            }
+        }
+    };
+    const size_t version = version_.load();
+    wait_for(1 - version);
+    version_.store(1 - version);
+    wait_for(version);
+}
+
+size_t SearchServer::GetReaderStripe() {
+    static atomic<size_t> next_stripe{0};
+    thread_local const size_t stripe = next_stripe.fetch_add(1) % READER_STRIPE_COUNT;
+    return stripe;
+}
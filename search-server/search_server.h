@@ -1,30 +1,101 @@
 #pragma once
-#include "string_processing.h"
-#include "document.h"
+#include "search_index.h"
+#include "versioned_cache.h"
+#include "write_ahead_log.h"
 
 #include <algorithm>
-#include <stdexcept>
-#include <utility>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
-#include <vector>
-#include <tuple>
-#include <set>
-#include <map>
-#include <execution>
-#include <typeinfo>
-#include <future>
-#include <list>
+#include <string_view>
 #include <thread>
+#include <vector>
+
+// Кэш разобранных запросов: план по тексту запроса, стоимость плана - 1
+using QueryPlanCache = VersionedCache<QueryPlan>;
+// Кэш результатов поиска по тексту запроса, статусу, max_count и политике;
+// стоимость записи - оценка занимаемой памяти в байтах
+using ResultCache = VersionedCache<std::vector<Document>>;
+
+// Обходит id документов, снятые SearchServer::begin под чтением: изменения
+// сервера во время обхода на него не влияют. Итератор по умолчанию - конец
+// любого обхода.
+class DocumentIdSnapshotIterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = int;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const int*;
+    using reference = const int&;
+
+    DocumentIdSnapshotIterator() = default;
+
+    explicit DocumentIdSnapshotIterator(std::shared_ptr<const std::vector<int>> ids)
+        : ids_(std::move(ids))
+    {}
 
-#include "concurrent_map.h"
+    reference operator*() const {
+        return (*ids_)[position_];
+    }
 
-const int MAX_RESULT_DOCUMENT_COUNT = 5;
+    pointer operator->() const {
+        return &(*ids_)[position_];
+    }
 
-using MatchedWords = std::tuple<std::vector<std::string_view>, DocumentStatus>;
+    DocumentIdSnapshotIterator& operator++() {
+        ++position_;
+        return *this;
+    }
 
+    DocumentIdSnapshotIterator operator++(int) {
+        DocumentIdSnapshotIterator result = *this;
+        ++position_;
+        return result;
+    }
+
+    bool operator==(const DocumentIdSnapshotIterator& other) const {
+        if (IsEnd() || other.IsEnd()) {
+            return IsEnd() && other.IsEnd();
+        }
+        return ids_ == other.ids_ && position_ == other.position_;
+    }
+
+    bool operator!=(const DocumentIdSnapshotIterator& other) const {
+        return !(*this == other);
+    }
+
+private:
+    std::shared_ptr<const std::vector<int>> ids_;
+    size_t position_ = 0;
+
+    bool IsEnd() const {
+        return !ids_ || position_ == ids_->size();
+    }
+};
+
+// Поисковый сервер, допускающий поиск одновременно с изменением документов.
+// Индекс хранится в двух копиях (схема Left-Right): читатели без блокировок
+// работают с опубликованной копией, писатель изменяет вторую, атомарно
+// переключает на неё читателей и, дождавшись ухода читателей старой копии,
+// повторяет на ней то же изменение. Писатели выполняются по одному.
+// Сегменты индекса неизменяемы и разделяются обеими копиями: заполненный
+// буфер превращается в сегмент один раз, а объединение сегментов строится
+// фоновым потоком вне блокировок и только подменяется в копиях.
+// Сервер, открытый OpenDurable, записывает каждое изменение в журнал и
+// возвращается из изменяющих методов, когда запись сохранена.
 class SearchServer {
 public:
     SearchServer() = default;
+    SearchServer(const SearchServer&) = delete;
+    SearchServer& operator=(const SearchServer&) = delete;
+    ~SearchServer();
 
     explicit SearchServer(const std::string & stop_words);
 
@@ -35,24 +106,62 @@ public:
 
     void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
 
+    // Добавляет документы так же, как последовательные вызовы AddDocument,
+    // включая исключения на ошибочном документе, но разбирает тексты один раз
+    // для обеих копий и с parallel_policy параллельно
+    template <typename ExecutionPolicy>
+    void AddDocuments(ExecutionPolicy&& policy, const std::vector<NewDocument>& documents);
+
+    void AddDocuments(const std::vector<NewDocument>& documents);
+
     template <typename ExecutionPolicy>
     void RemoveDocument(ExecutionPolicy && policy, int document_id);
 
     void RemoveDocument(int document_id);
 
-    const std::map<std::string_view, double>&
-    GetWordFrequencies(int document_id) const;
+    // Удаляет документы одним изменением индекса, см. SearchIndex::RemoveDocuments
+    template <typename ExecutionPolicy>
+    void RemoveDocuments(ExecutionPolicy&& policy, const std::vector<int>& document_ids);
 
+    void RemoveDocuments(const std::vector<int>& document_ids);
+
+    // Копия слов документа с их TF, см. SearchIndex::GetDocumentTerms
+    std::vector<DocumentTerm> GetDocumentTerms(int document_id) const;
+
+    // Вызывает function(const std::vector<DocumentFingerprint>&) с документами
+    // опубликованной копии, см. SearchIndex::GetDocumentFingerprints. Виды слов
+    // действительны только внутри function; изменения сервера ждут её завершения.
+    template <typename Function>
+    auto ReadDocumentFingerprints(Function function) const;
+
+    // Для совместимости: слова документа с TF картой, построенной при вызове
+    std::map<std::string_view, double> GetWordFrequencies(int document_id) const;
+
+    // max_count ограничивает число возвращаемых документов
     template <typename ExecutionPolicy>
-    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL) const;
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+                                           DocumentStatus status = DocumentStatus::ACTUAL,
+                                           size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
     template <typename Predicate>
-    std::vector<Document> FindTopDocuments(std::string_view raw_query, Predicate predicate) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, Predicate predicate,
+                                           size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
     template <typename ExecutionPolicy, typename Predicate>
-    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, Predicate predicate) const;
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, Predicate predicate,
+                                           size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
-    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query,
+                                           DocumentStatus status = DocumentStatus::ACTUAL,
+                                           size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    // Результаты FindTopDocuments(raw_query, status, max_count) для каждого
+    // запроса. Запросы пакета ищутся вместе, см. SearchIndex::FindTopDocumentsBatch,
+    // одинаковые тексты - один раз; кэши используются так же, как при поиске
+    // по одному. Бросает исключение первого ошибочного запроса.
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(const std::vector<std::string>& raw_queries,
+                                                             DocumentStatus status = DocumentStatus::ACTUAL,
+                                                             size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
     int GetDocumentCount() const;
 
@@ -61,65 +170,145 @@ public:
 
     MatchedWords MatchDocument(std::string_view raw_query, int document_id) const;
 
-    std::set<int>::const_iterator begin() const;
-    std::set<int>::const_iterator end() const;
+    // begin копирует id опубликованной копии, поэтому обход можно совмещать
+    // с изменениями сервера, в том числе из того же цикла
+    DocumentIdSnapshotIterator begin() const;
+    DocumentIdSnapshotIterator end() const;
+
+    // Ёмкость кэша разобранных запросов, которым пользуются FindTopDocuments
+    // и MatchDocument; 0 (по умолчанию) выключает кэш. Можно менять
+    // одновременно с поиском.
+    void SetQueryPlanCacheCapacity(size_t capacity);
+
+    QueryPlanCache::Stats GetQueryPlanCacheStats() const;
+
+    // Бюджет памяти кэша результатов FindTopDocuments по статусу в байтах;
+    // 0 (по умолчанию) выключает кэш. Результаты поиска с предикатом-функцией
+    // не кэшируются. Любое изменение документов или стоп-слов делает
+    // сохранённые результаты устаревшими. Можно менять одновременно с поиском.
+    void SetResultCacheBudget(size_t budget);
+
+    ResultCache::Stats GetResultCacheStats() const;
+
+    // Записывает опубликованную копию индекса в файл снимка; изменения
+    // сервера ждут окончания записи
+    void SaveSnapshot(const std::string& path) const;
+
+    // Сервер, открытый из снимка SaveSnapshot. Списки вхождений читаются
+    // прямо из отображённого в память файла.
+    static SearchServer OpenSnapshot(const std::string& path);
+
+    // Сервер, сохраняющий изменения в каталоге directory: восстанавливает
+    // индекс из последнего снимка и журнала изменений после него, а дальше
+    // записывает изменения в журнал. Изменения, бросившие исключение, в журнал
+    // не попадают, а у частично применённых (AddDocuments, SetStopWords)
+    // записывается только применённая часть.
+    static SearchServer OpenDurable(const std::string& directory, WriteAheadLog::Options options = {});
+
+    // Записывает снимок в каталог сервера и удаляет журнал до него.
+    // Изменения сервера ждут окончания записи.
+    void Checkpoint();
+
+    // Объединяет и уплотняет сегменты в вызывающем потоке, пока политика
+    // находит, что делать. Обычно это делает фоновый поток после сброса буфера
+    // или когда удалённых документов в сегментах становится много.
+    void MergeSegments();
+
+    size_t GetSegmentCount() const;
 
 private:
-    struct DocumentData {
-        int rating = 0;
-        DocumentStatus status = DocumentStatus::ACTUAL;
+    // счётчики читателей разнесены по кэш-линиям, чтобы потоки-читатели
+    // не конкурировали за одну переменную
+    struct alignas(64) ReaderCounter {
+        std::atomic<int64_t> count{0};
     };
+    static constexpr size_t READER_STRIPE_COUNT = 16;
+    using ReaderIndicator = std::array<ReaderCounter, READER_STRIPE_COUNT>;
 
-    struct Query {
-        std::vector<std::string> plus_words;
-        std::vector<std::string> minus_words;
-    };
+    std::array<SearchIndex, 2> indexes_;
+    // копия, которую видят новые читатели
+    std::atomic<size_t> read_index_{0};
+    // индикатор, в котором отмечаются новые читатели
+    std::atomic<size_t> version_{0};
+    mutable std::array<ReaderIndicator, 2> readers_;
+    std::mutex write_mutex_;
 
-    std::set<std::string, std::less<>> stop_words_;
-    std::map<std::string, std::map<int, double>> word_to_document_freqs_;
-    std::map<int, std::map<std::string_view, double>> document_to_word_freqs_;
-    std::map<int, DocumentData> documents_;
-    std::set<int> documents_indexes_;
+    // объединения выполняются по одному
+    std::mutex merge_mutex_;
+    // состояние фонового потока объединения
+    std::mutex merge_thread_mutex_;
+    std::condition_variable merge_wake_up_;
+    bool merge_requested_ = false;
+    bool stopping_ = false;
+    std::thread merge_thread_;
 
-    bool IsStopWord(std::string_view word) const;
+    // журнал сервера, открытого OpenDurable, и его каталог
+    std::unique_ptr<WriteAheadLog> wal_;
+    std::string durable_directory_;
 
-    std::vector<std::string_view> SplitIntoWordsNoStop(std::string_view text) const;
+    mutable QueryPlanCache query_plan_cache_;
+    mutable ResultCache result_cache_;
 
-    static int ComputeAverageRating(const std::vector<int>& ratings);
+    explicit SearchServer(const SnapshotReader& reader);
 
-    struct QueryWord {
-        std::string data;
-        bool is_minus;
-        bool is_stop;
-    };
+    SearchServer(const std::string& directory, const WriteAheadLog::Options& options);
 
-    QueryWord ParseQueryWord(std::string_view text) const;
+    // Открывает обе копии из снимка
+    void OpenIndexes(const SnapshotReader& reader);
 
-    Query ParseQuery(std::string_view text, bool need_sort = true) const;
+    // Применяет к индексу записи журнала из directory начиная с файла first_segment
+    void ReplayLog(const std::string& directory, uint64_t first_segment);
 
-    // Existence required
-    double ComputeWordInverseDocumentFreq(const std::string& word) const;
+    // План запроса из кэша или разобранный в index и добавленный в кэш
+    void GetQueryPlan(const SearchIndex& index, std::string_view raw_query, QueryPlan& plan) const;
 
-    template<typename Predicate>
-    std::vector<Document> FindAllDocuments(const Query& query,
-                                           Predicate predicate) const;
+    // Тег записи кэша результатов; nullopt, если max_count в нём не помещается
+    template <typename ExecutionPolicy>
+    static std::optional<uint64_t> GetResultCacheTag(DocumentStatus status, size_t max_count);
 
-    template<typename Predicate>
-    std::vector<Document> FindAllDocuments(std::execution::parallel_policy,
-                                           const Query& query,
-                                           Predicate predicate) const;
+    static size_t GetResultCacheCost(std::string_view raw_query, const std::vector<Document>& documents);
 
-    template<typename Predicate>
-    std::vector<Document> FindAllDocuments(std::execution::sequenced_policy,
-                                           const Query& query,
-                                           Predicate predicate) const;
+    // Вызывает function(const SearchIndex&) для опубликованной копии
+    template <typename Function>
+    auto Read(Function function) const;
 
-    bool HasSpecialSymbols(std::string_view text) const {
-        bool result = std::any_of(text.begin(), text.end(), [](const char ch) {
-            return (ch >= 0 && ch <= 31);
-        });
-        return result;
-    }
+    // Применяет function(SearchIndex&) к обеим копиям. Если изменение бросает
+    // исключение, оно всё равно применяется к обеим, чтобы копии не разошлись,
+    // и исключение пробрасывается вызывающему; разный исход на копиях
+    // завершает процесс, см. CheckCopiesAgree.
+    template <typename Function>
+    void Write(Function function);
+
+    // То же, но, если есть журнал и изменение удалось, записывает его после
+    // применения, чтобы log видел, что применилось: log(WriteAheadLog&)
+    // возвращает номер последней записи или 0, если записывать нечего.
+    // Изменение, частично применённое до исключения, должно само поймать
+    // исключение, записать применённую часть и бросить его после Write.
+    // Возвращается, когда записи сохранены; другие писатели тем временем не ждут.
+    template <typename Log, typename Function>
+    void Write(Log log, Function function);
+
+    // Применяет function к обеим копиям под write_mutex_ и возвращает исключение изменения
+    template <typename Function>
+    std::exception_ptr ApplyToCopies(Function& function);
+
+    // Завершает процесс, если изменение закончилось на копиях по-разному
+    // (например, на одной из них не хватило памяти) и копии могли разойтись:
+    // читатели получали бы разные ответы в зависимости от опубликованной копии
+    void CheckCopiesAgree(const std::exception_ptr& first_error, const std::exception_ptr& second_error) const;
+
+    // Ждёт, пока копию, с которой сняли публикацию, покинут все читатели
+    void WaitForReaders();
+
+    static size_t GetReaderStripe();
+
+    // Слова text до первого ошибочного, которые SetStopWords успевает добавить
+    static std::string GetValidStopWords(std::string_view text);
+
+    // Будит фоновый поток объединения, запуская его при первом вызове
+    void RequestMerge();
+
+    void RunMergeThread();
 };
 
 template<class StringContainer>
@@ -129,176 +318,243 @@ SearchServer::SearchServer(const StringContainer & container) {
     }
 }
 
-template <typename ExecutionPolicy>
-std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentStatus status) const {
-    auto predicate = [status](int, DocumentStatus predicate_status, int) {
-        return predicate_status == status;
-    };
-    return FindTopDocuments(policy, raw_query, predicate);
+template <typename Function>
+auto SearchServer::Read(Function function) const {
+    ReaderCounter & counter = readers_[version_.load()][GetReaderStripe()];
+    counter.count.fetch_add(1);
+    struct Leave {
+        ReaderCounter & counter;
+        ~Leave() {
+            counter.count.fetch_sub(1);
+        }
+    } leave{counter};
+    return function(indexes_[read_index_.load()]);
 }
 
-template <typename Predicate>
-std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, Predicate predicate) const {
-    return FindTopDocuments(std::execution::seq, raw_query, predicate);
+template <typename Function>
+auto SearchServer::ReadDocumentFingerprints(Function function) const {
+    return Read([&function](const SearchIndex & index) {
+        return function(index.GetDocumentFingerprints());
+    });
 }
 
-template <typename ExecutionPolicy, typename Predicate>
-std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, Predicate predicate) const {
-    const Query query = ParseQuery(raw_query);
-    auto matched_documents = FindAllDocuments(policy, query, predicate);
-    std::sort(policy, matched_documents.begin(), matched_documents.end(), CompareByRelevance());
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+template <typename Function>
+void SearchServer::Write(Function function) {
+    std::exception_ptr error;
+    {
+        std::lock_guard lock(write_mutex_);
+        error = ApplyToCopies(function);
+    }
+    if (error) {
+        std::rethrow_exception(error);
     }
-    return matched_documents;
-}
-
-template<typename Predicate>
-std::vector<Document> SearchServer::FindAllDocuments(const Query& query, Predicate predicate) const {
-    return FindAllDocuments(std::execution::seq, query, predicate);
 }
 
-template<typename Predicate>
-std::vector<Document> SearchServer::FindAllDocuments(std::execution::sequenced_policy, const Query& query, Predicate predicate) const {
-    std::map<int, double> document_to_relevance;
-    for (const std::string& word : query.plus_words) {
-        auto it_word2doc = word_to_document_freqs_.find(word);
-        if (it_word2doc != word_to_document_freqs_.end()) {
-            const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-            for (const auto [document_id, term_freq] : it_word2doc->second) {
-                const DocumentData & doc_data = documents_.at(document_id);
-                if ( predicate(document_id, doc_data.status, doc_data.rating) ) {
-                    document_to_relevance[document_id] += term_freq * inverse_document_freq;
-                }
-            }
+template <typename Log, typename Function>
+void SearchServer::Write(Log log, Function function) {
+    uint64_t lsn = 0;
+    std::exception_ptr error;
+    {
+        std::lock_guard lock(write_mutex_);
+        error = ApplyToCopies(function);
+        // записи журнала идут в том же порядке, что и изменения копий; до Commit
+        // они только в буфере, поэтому запись после применения ничего не теряет.
+        // Неудавшееся изменение не записывается: при восстановлении оно бросило
+        // бы то же исключение и сервер нельзя было бы открыть.
+        if (wal_ && !error) {
+            lsn = log(*wal_);
         }
     }
-
-    for (const std::string& word : query.minus_words) {
-        auto it_word2doc = word_to_document_freqs_.find(word);
-        if (it_word2doc != word_to_document_freqs_.end()) {
-            for (const auto [document_id, _] : it_word2doc->second) {
-                document_to_relevance.erase(document_id);
-            }
-        }
+    if (lsn != 0) {
+        wal_->Commit(lsn);
     }
-
-    std::vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : document_to_relevance) {
-        matched_documents.push_back({
-            document_id,
-            relevance,
-            documents_.at(document_id).rating
-        });
+    if (error) {
+        std::rethrow_exception(error);
     }
-    return matched_documents;
 }
 
-template<typename Predicate>
-std::vector<Document> SearchServer::FindAllDocuments(std::execution::parallel_policy, const Query& query, Predicate predicate) const {
-    const size_t max_threads = std::thread::hardware_concurrency();
-    ConcurrentMap<int, double> document_to_relevance(max_threads);
-    {
-        auto check_plus_word = [this, &document_to_relevance, &predicate](const std::string& word) {
-            auto it_word2doc = word_to_document_freqs_.find(word);
-            if (it_word2doc != word_to_document_freqs_.end()) {
-                const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-                for (const auto [document_id, term_freq] : it_word2doc->second) {
-                    const DocumentData & doc_data = documents_.at(document_id);
-                    if ( predicate(document_id, doc_data.status, doc_data.rating) ) {
-                        document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
-                    }
-                }
-            }
-        };
-        Futures futures;
-        AsyncsRun(query.plus_words, check_plus_word, futures, max_threads);
-        AsyncsWait(futures);
+template <typename Function>
+std::exception_ptr SearchServer::ApplyToCopies(Function& function) {
+    const size_t read_index = read_index_.load();
+    std::exception_ptr error;
+    try {
+        function(indexes_[1 - read_index]);
+    } catch (...) {
+        error = std::current_exception();
+    }
+    read_index_.store(1 - read_index);
+    WaitForReaders();
+    std::exception_ptr second_error;
+    try {
+        function(indexes_[read_index]);
+    } catch (...) {
+        second_error = std::current_exception();
     }
+    CheckCopiesAgree(error, second_error);
+    return error;
+}
 
-    {
-        auto check_minus_word = [this, &document_to_relevance](const std::string& word) {
-            auto it_word2doc = word_to_document_freqs_.find(word);
-            if (it_word2doc != word_to_document_freqs_.end()) {
-                for (const auto [document_id, _] : it_word2doc->second) {
-                    document_to_relevance.erase(document_id);
-                }
+template <typename ExecutionPolicy>
+void SearchServer::AddDocuments(ExecutionPolicy&& policy, const std::vector<NewDocument>& documents) {
+    // разбор и сегменты из заполненного буфера делаются при первом применении
+    std::optional<SearchIndex::DocumentBatch> batch;
+    std::vector<std::shared_ptr<const IndexSegment>> segments;
+    // документы, добавленные до ошибочного; в журнал попадают только они,
+    // иначе восстановление добавило бы и документы после ошибки
+    std::optional<size_t> added_count;
+    // исключение пакета на первой копии; бросается после записи в журнал
+    std::exception_ptr error;
+    auto log = [&documents, &added_count](WriteAheadLog & wal) {
+        uint64_t lsn = 0;
+        for (size_t i = 0; i < *added_count; ++i) {
+            const NewDocument & document = documents[i];
+            lsn = wal.AppendAddDocument(document.id, document.text, document.status, document.ratings);
+        }
+        return lsn;
+    };
+    Write(log, [&](SearchIndex & index) {
+        if (!batch) {
+            batch = index.PrepareDocuments(policy, documents);
+        }
+        const int document_count = index.GetDocumentCount();
+        size_t flush_count = 0;
+        auto flush_if_full = [&index, &segments, &flush_count]() {
+            if (!index.IsBufferFull()) {
+                return;
             }
+            if (flush_count == segments.size()) {
+                segments.push_back(index.BuildBufferSegment());
+            }
+            index.FlushBuffer(segments[flush_count++]);
         };
-        Futures futures;
-        AsyncsRun(query.minus_words, check_minus_word, futures, max_threads);
-        AsyncsWait(futures);
+        size_t copy_added_count = documents.size();
+        std::exception_ptr copy_error;
+        try {
+            // буфер сбрасывается на тех же документах, что и при добавлении по одному
+            for (size_t first = 0; first < documents.size();) {
+                flush_if_full();
+                const size_t last = std::min(documents.size(), first + index.GetBufferFreeCount());
+                index.AddDocuments(*batch, first, last);
+                first = last;
+            }
+            flush_if_full();
+        } catch (...) {
+            copy_added_count = static_cast<size_t>(index.GetDocumentCount() - document_count);
+            copy_error = std::current_exception();
+        }
+        if (!added_count) {
+            added_count = copy_added_count;
+            error = copy_error;
+        } else if (*added_count != copy_added_count) {
+            throw std::logic_error("AddDocuments: copies added different documents");
+        }
+    });
+    if (!segments.empty()) {
+        RequestMerge();
     }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
 
-    std::vector<Document> matched_documents;
-    auto matched_documents_transform = [this, &matched_documents](const std::map<int, double> & map, size_t it) {
-        for (const auto [document_id, relevance] : map) {
-            matched_documents[it++] = Document{
-                document_id,
-                relevance,
-                documents_.at(document_id).rating
-            };
+template <typename ExecutionPolicy>
+void SearchServer::RemoveDocuments(ExecutionPolicy&& policy, const std::vector<int>& document_ids) {
+    bool needs_compaction = false;
+    auto log = [&document_ids](WriteAheadLog & wal) {
+        uint64_t lsn = 0;
+        for (const int document_id : document_ids) {
+            lsn = wal.AppendRemoveDocument(document_id);
         }
+        return lsn;
     };
-    matched_documents.resize(document_to_relevance.size());
-    Futures futures;
-    size_t ita, itb = 0;
-    for (size_t i = 0; i < max_threads; ++i) {
-        const auto & map = document_to_relevance.GetMap(i);
-        ita = itb;
-        itb = ita + map.size();
-        futures.push_back( std::async(std::launch::async, matched_documents_transform, map, ita ) );
+    Write(log, [&policy, &document_ids, &needs_compaction](SearchIndex & index) {
+        index.RemoveDocuments(policy, document_ids);
+        needs_compaction = index.NeedsCompaction();
+    });
+    if (needs_compaction) {
+        RequestMerge();
     }
-    AsyncsWait(futures);
-    return matched_documents;
 }
 
 template <typename ExecutionPolicy>
 void SearchServer::RemoveDocument(ExecutionPolicy && policy, int document_id) {
-    auto iterator = document_to_word_freqs_.find(document_id);
-    if (iterator == document_to_word_freqs_.end()) {
-        return;
-    }
-    const auto & m = iterator->second;
-    std::vector<std::string> to_delete;
-    to_delete.reserve(m.size());
-    for (const auto & [word, _] : m) {
-        to_delete.emplace_back(word);
+    bool needs_compaction = false;
+    auto log = [document_id](WriteAheadLog & wal) {
+        return wal.AppendRemoveDocument(document_id);
+    };
+    Write(log, [&policy, document_id, &needs_compaction](SearchIndex & index) {
+        index.RemoveDocument(policy, document_id);
+        needs_compaction = index.NeedsCompaction();
+    });
+    if (needs_compaction) {
+        RequestMerge();
     }
-    std::for_each(policy,
-        to_delete.begin(), to_delete.end(),
-        [document_id, this](const std::string & word) {
-            word_to_document_freqs_[word].erase(document_id);
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+                                                     DocumentStatus status, size_t max_count) const {
+    const std::optional<uint64_t> tag = GetResultCacheTag<ExecutionPolicy>(status, max_count);
+    return Read([&](const SearchIndex & index) {
+        // поколение той копии, по которой считается результат
+        const uint64_t generation = index.GetGeneration();
+        std::vector<Document> documents;
+        if (tag && result_cache_.Find(raw_query, *tag, generation, documents)) {
+            return documents;
+        }
+        QueryPlan query;
+        GetQueryPlan(index, raw_query, query);
+        documents = index.FindTopDocuments(policy, query, status, max_count);
+        if (tag && result_cache_.GetBudget() > 0) {
+            result_cache_.Insert(raw_query, *tag, generation, documents, GetResultCacheCost(raw_query, documents));
         }
-    );
-    document_to_word_freqs_.erase(document_id);
-    documents_indexes_.erase(document_id);
-    documents_.erase(document_id);
+        return documents;
+    });
 }
 
 template <typename ExecutionPolicy>
-MatchedWords SearchServer::MatchDocument(ExecutionPolicy && policy, std::string_view raw_query, int document_id) const {
-    auto it_to_documents_data = documents_.find(document_id);
-    if (it_to_documents_data == documents_.end()) {
-        throw std::out_of_range("MatchDocument: document_id "
-            + std::to_string(document_id) + " not found.");
+std::optional<uint64_t> SearchServer::GetResultCacheTag(DocumentStatus status, size_t max_count) {
+    // политика входит в ключ: параллельный поиск может сложить релевантность в другом порядке
+    using Policy = std::decay_t<ExecutionPolicy>;
+    uint64_t policy_kind = 0;
+    if constexpr (std::is_same_v<Policy, std::execution::parallel_policy>) {
+        policy_kind = 1;
+    } else if constexpr (std::is_same_v<Policy, search_engine::wand_policy>) {
+        policy_kind = 2;
+    } else if constexpr (!std::is_same_v<Policy, std::execution::sequenced_policy>) {
+        return std::nullopt;
     }
-    const Query query = ParseQuery(raw_query);
-    for (const std::string & minus_word : query.minus_words) {
-        auto it_to_set = word_to_document_freqs_.find(minus_word);
-        if (it_to_set == word_to_document_freqs_.end() || 
-            it_to_set->second.count(document_id)) {
-            return { {}, it_to_documents_data->second.status };
-        }
+    if (max_count > UINT32_MAX) {
+        return std::nullopt;
     }
-    std::vector<std::string_view> matched_words;
-    matched_words.reserve(query.plus_words.size());
-    for (const std::string & plus_word : query.plus_words) {
-        auto it_to_set = word_to_document_freqs_.find(plus_word);
-        if (it_to_set != word_to_document_freqs_.end() &&
-            it_to_set->second.count(document_id)) {
-            matched_words.push_back(it_to_set->first);
+    return (static_cast<uint64_t>(max_count) << 16) | (static_cast<uint64_t>(status) << 8) | policy_kind;
+}
+
+template <typename Predicate>
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, Predicate predicate,
+                                                     size_t max_count) const {
+    return FindTopDocuments(std::execution::seq, raw_query, predicate, max_count);
+}
+
+template <typename ExecutionPolicy, typename Predicate>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, Predicate predicate,
+                                                     size_t max_count) const {
+    return Read([&](const SearchIndex & index) {
+        QueryPlan query;
+        GetQueryPlan(index, raw_query, query);
+        return index.FindTopDocuments(policy, query, predicate, max_count);
+    });
+}
+
+template <typename ExecutionPolicy>
+MatchedWords SearchServer::MatchDocument(ExecutionPolicy && policy, std::string_view raw_query, int document_id) const {
+    return Read([&](const SearchIndex & index) {
+        // несуществующий документ проверяется раньше разбора запроса
+        if (!index.HasDocument(document_id)) {
+            return index.MatchDocument(policy, raw_query, document_id);
         }
-    }
-    return { matched_words, it_to_documents_data->second.status };
+        QueryPlan query;
+        GetQueryPlan(index, raw_query, query);
+        return index.MatchDocument(policy, query, document_id);
+    });
 }
@@ -0,0 +1,221 @@
+#include "snapshot.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+const char SNAPSHOT_MAGIC[8] = {'S', 'S', 'I', 'N', 'D', 'E', 'X', '\0'};
+
+uint64_t RotateLeft(uint64_t value, int shift) {
+    return (value << shift) | (value >> (64 - shift));
+}
+
+bool SyncFile(const char* path, int flags) {
+    const int fd = open(path, flags);
+    if (fd < 0) {
+        return false;
+    }
+    const bool synced = fsync(fd) == 0;
+    close(fd);
+    return synced;
+}
+
+}
+
+void SnapshotChecksum::Update(const void* data, size_t size) {
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    total_size_ += size;
+    while (size > 0 && tail_size_ > 0) {
+        tail_[tail_size_++] = *bytes++;
+        --size;
+        if (tail_size_ == sizeof(tail_)) {
+            uint64_t word;
+            memcpy(&word, tail_, sizeof(word));
+            Mix(word);
+            tail_size_ = 0;
+        }
+    }
+    if (tail_size_ > 0) {
+        return;
+    }
+    for (; size >= sizeof(uint64_t); bytes += sizeof(uint64_t), size -= sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, bytes, sizeof(word));
+        Mix(word);
+    }
+    memcpy(tail_, bytes, size);
+    tail_size_ = size;
+}
+
+uint64_t SnapshotChecksum::Finish() const {
+    SnapshotChecksum result = *this;
+    uint64_t word = 0;
+    memcpy(&word, tail_, tail_size_);
+    result.Mix(word);
+    result.Mix(total_size_);
+    uint64_t state = result.state_;
+    state ^= state >> 33;
+    state *= 0xFF51AFD7ED558CCDull;
+    state ^= state >> 33;
+    return state;
+}
+
+void SnapshotChecksum::Mix(uint64_t word) {
+    state_ = RotateLeft(state_ ^ (word * 0x87C37B91114253D5ull), 31) * 0x4CF5AD432745937Full + 0x52DCE729ull;
+}
+
+MappedFile::MappedFile(const string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("OpenSnapshot: cannot open '"s + path + "'"s);
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size <= 0) {
+        close(fd);
+        throw runtime_error("OpenSnapshot: cannot read '"s + path + "'"s);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    // отображение остаётся действительным и после закрытия дескриптора
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw runtime_error("OpenSnapshot: cannot map '"s + path + "'"s);
+    }
+    data_ = static_cast<const uint8_t*>(data);
+}
+
+MappedFile::~MappedFile() {
+    munmap(const_cast<uint8_t*>(data_), size_);
+}
+
+SnapshotWriter::SnapshotWriter(string path)
+    : path_(move(path))
+    , temp_path_(path_ + ".tmp"s)
+    , out_(temp_path_, ios::binary | ios::trunc)
+{
+    if (!out_) {
+        throw runtime_error("SaveSnapshot: cannot create '"s + temp_path_ + "'"s);
+    }
+    // заголовок записывается в Finish, когда известны каталог и контрольная сумма
+    const SnapshotHeader header{};
+    out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+void SnapshotWriter::BeginSection(SnapshotSectionKind kind) {
+    sections_.push_back({kind, 0, offset_, 0, 0});
+    checksum_ = {};
+}
+
+void SnapshotWriter::EndSection() {
+    SnapshotSection & section = sections_.back();
+    section.size = offset_ - section.offset;
+    section.checksum = checksum_.Finish();
+    static const char padding[8] = {};
+    WriteBytes(padding, (8 - offset_ % 8) % 8);
+}
+
+void SnapshotWriter::Finish() {
+    const uint64_t directory_offset = offset_;
+    checksum_ = {};
+    Write(sections_);
+
+    SnapshotHeader header{};
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.section_count = static_cast<uint32_t>(sections_.size());
+    header.directory_offset = directory_offset;
+    header.file_size = offset_;
+    header.checksum = checksum_.Finish();
+    out_.seekp(0);
+    out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out_.close();
+    if (!out_ || !SyncFile(temp_path_.c_str(), O_RDONLY) || rename(temp_path_.c_str(), path_.c_str()) != 0) {
+        remove(temp_path_.c_str());
+        throw runtime_error("SaveSnapshot: cannot write '"s + path_ + "'"s);
+    }
+    // переименование сохраняется вместе с каталогом
+    const size_t slash = path_.find_last_of('/');
+    SyncFile(slash == string::npos ? "." : path_.substr(0, max<size_t>(slash, 1)).c_str(), O_RDONLY | O_DIRECTORY);
+}
+
+void SnapshotWriter::WriteBytes(const void* data, size_t size) {
+    out_.write(static_cast<const char*>(data), static_cast<streamsize>(size));
+    checksum_.Update(data, size);
+    offset_ += size;
+}
+
+SnapshotReader::SnapshotReader(shared_ptr<const MappedFile> file, bool verify_sections)
+    : file_(move(file))
+    , verify_sections_(verify_sections)
+{
+    const uint8_t* data = file_->data();
+    const size_t size = file_->size();
+    SnapshotHeader header;
+    if (size < sizeof(header)) {
+        throw runtime_error("OpenSnapshot: not a snapshot file"s);
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+        throw runtime_error("OpenSnapshot: not a snapshot file"s);
+    }
+    if (header.version != SNAPSHOT_VERSION) {
+        throw runtime_error("OpenSnapshot: unsupported version "s + to_string(header.version));
+    }
+    if (header.file_size != size || header.directory_offset % 8 != 0
+        || header.directory_offset > size
+        || (size - header.directory_offset) / sizeof(SnapshotSection) != header.section_count) {
+        throw runtime_error("OpenSnapshot: file is truncated or damaged"s);
+    }
+    SnapshotChecksum checksum;
+    checksum.Update(data + header.directory_offset, size - header.directory_offset);
+    if (checksum.Finish() != header.checksum) {
+        throw runtime_error("OpenSnapshot: checksum mismatch"s);
+    }
+
+    sections_ = reinterpret_cast<const SnapshotSection*>(data + header.directory_offset);
+    section_count_ = header.section_count;
+    for (size_t i = 0; i < section_count_; ++i) {
+        const SnapshotSection & section = sections_[i];
+        if (section.offset % 8 != 0 || section.offset < sizeof(header)
+            || section.offset > header.directory_offset
+            || section.size > header.directory_offset - section.offset) {
+            throw runtime_error("OpenSnapshot: file is truncated or damaged"s);
+        }
+    }
+}
+
+SnapshotReader::Bytes SnapshotReader::GetSection(SnapshotSectionKind kind) const {
+    const vector<Bytes> sections = GetSections(kind);
+    if (sections.size() != 1) {
+        throw runtime_error("OpenSnapshot: missing section "s + to_string(static_cast<uint32_t>(kind)));
+    }
+    return sections.front();
+}
+
+vector<SnapshotReader::Bytes> SnapshotReader::GetSections(SnapshotSectionKind kind) const {
+    vector<Bytes> result;
+    for (size_t i = 0; i < section_count_; ++i) {
+        if (sections_[i].kind != kind) {
+            continue;
+        }
+        const Bytes bytes{file_->data() + sections_[i].offset, static_cast<size_t>(sections_[i].size)};
+        if (verify_sections_) {
+            SnapshotChecksum checksum;
+            checksum.Update(bytes.data, bytes.size);
+            if (checksum.Finish() != sections_[i].checksum) {
+                throw runtime_error("OpenSnapshot: checksum mismatch"s);
+            }
+        }
+        result.push_back(bytes);
+    }
+    return result;
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Файл снимка индекса:
+//   SnapshotHeader
+//   секции, каждая начинается с границы 8 байт
+//   каталог секций - массив SnapshotSection
+// Числа записаны в порядке байтов машины, записавшей снимок. Контрольная
+// сумма заголовка покрывает каталог, у каждой секции своя контрольная сумма,
+// поэтому секция проверяется, только когда её читают.
+constexpr uint32_t SNAPSHOT_VERSION = 5;
+
+enum class SnapshotSectionKind : uint32_t {
+    STOP_WORDS,
+    TERM_OFFSETS,
+    TERM_CHARS,
+    DOCUMENT_FREQS,
+    DOCUMENT_IDS,
+    DOCUMENT_RATINGS,
+    DOCUMENT_STATUSES,
+    FORWARD_OFFSETS,
+    FORWARD_TERMS,
+    FORWARD_TERM_FREQS,
+    TOMBSTONES,
+    // по секции на сегмент, в порядке номеров документов
+    SEGMENT,
+    // первый файл журнала изменений, не вошедших в снимок
+    LOG_POSITION,
+    // номера всех удалённых документов, включая вычищенные из сегментов
+    REMOVED_DOCUMENTS,
+};
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t section_count;
+    uint64_t directory_offset;
+    uint64_t file_size;
+    uint64_t checksum;
+};
+
+struct SnapshotSection {
+    SnapshotSectionKind kind;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+    uint64_t checksum;
+};
+
+// Потоковая 64-битная контрольная сумма: результат не зависит от того,
+// какими частями переданы данные
+class SnapshotChecksum {
+public:
+    void Update(const void* data, size_t size);
+    uint64_t Finish() const;
+
+private:
+    uint64_t state_ = 0x9E3779B97F4A7C15ull;
+    uint64_t total_size_ = 0;
+    uint8_t tail_[8] = {};
+    size_t tail_size_ = 0;
+
+    void Mix(uint64_t word);
+};
+
+// Файл, отображённый в память только для чтения
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    const uint8_t* data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Пишет снимок во временный файл и в Finish, сохранив его на диск,
+// переименовывает в path, поэтому недописанный снимок никогда не заменяет прежний
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(std::string path);
+
+    void BeginSection(SnapshotSectionKind kind);
+
+    template <typename T>
+    void Write(const T* data, size_t count) {
+        WriteBytes(data, count * sizeof(T));
+    }
+
+    template <typename T>
+    void Write(const std::vector<T>& values) {
+        Write(values.data(), values.size());
+    }
+
+    void EndSection();
+
+    void Finish();
+
+private:
+    std::string path_;
+    std::string temp_path_;
+    std::ofstream out_;
+    uint64_t offset_ = sizeof(SnapshotHeader);
+    // контрольная сумма открытой секции
+    SnapshotChecksum checksum_;
+    std::vector<SnapshotSection> sections_;
+
+    void WriteBytes(const void* data, size_t size);
+};
+
+// Секции проверенного снимка. Данные не копируются: массивы указывают
+// прямо в отображённый файл.
+class SnapshotReader {
+public:
+    struct Bytes {
+        const uint8_t* data;
+        size_t size;
+    };
+
+    // Проверяет заголовок, каталог и границы секций. Контрольные суммы секций
+    // проверяются при их чтении, а без verify_sections не проверяются вовсе.
+    explicit SnapshotReader(std::shared_ptr<const MappedFile> file, bool verify_sections = true);
+
+    // Единственная секция вида kind
+    Bytes GetSection(SnapshotSectionKind kind) const;
+
+    // Все секции вида kind в порядке записи; бросает runtime_error, если
+    // контрольная сумма одной из них не сходится
+    std::vector<Bytes> GetSections(SnapshotSectionKind kind) const;
+
+    // Массив из единственной секции вида kind
+    template <typename T>
+    const T* GetArray(SnapshotSectionKind kind, size_t& count) const {
+        return AsArray<T>(GetSection(kind), count);
+    }
+
+    template <typename T>
+    static const T* AsArray(Bytes bytes, size_t& count) {
+        if (bytes.size % sizeof(T) != 0) {
+            throw std::runtime_error("OpenSnapshot: bad section size");
+        }
+        count = bytes.size / sizeof(T);
+        return reinterpret_cast<const T*>(bytes.data);
+    }
+
+    const std::shared_ptr<const MappedFile>& GetFile() const {
+        return file_;
+    }
+
+private:
+    std::shared_ptr<const MappedFile> file_;
+    const SnapshotSection* sections_ = nullptr;
+    size_t section_count_ = 0;
+    bool verify_sections_;
+};
@@ -1,21 +1,82 @@
 #include "string_processing.h"
 #include <algorithm>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 using namespace std;
 
+namespace {
+
+bool IsSpecialSymbol(char ch) {
+    return static_cast<unsigned char>(ch) < ' ';
+}
+
+#if defined(__SSE2__)
+constexpr size_t VECTOR_SIZE = sizeof(__m128i);
+
+// Маска позиций 16 байт с пробелами
+unsigned GetSpaceMask(__m128i bytes) {
+    return static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' '))));
+}
+
+// Маска позиций 16 байт с кодами не больше пробела: сами пробелы и управляющие символы
+unsigned GetSpaceOrSpecialMask(__m128i bytes) {
+    const __m128i space = _mm_set1_epi8(' ');
+    return static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(bytes, space), bytes)));
+}
+#endif
+
+const char* SkipSpaces(const char* position, const char* end) {
+#if defined(__SSE2__)
+    for (; end - position >= static_cast<ptrdiff_t>(VECTOR_SIZE); position += VECTOR_SIZE) {
+        const unsigned non_space_mask = ~GetSpaceMask(_mm_loadu_si128(reinterpret_cast<const __m128i*>(position))) & 0xFFFF;
+        if (non_space_mask != 0) {
+            return position + __builtin_ctz(non_space_mask);
+        }
+    }
+#endif
+    while (position != end && *position == ' ') {
+        ++position;
+    }
+    return position;
+}
+
+// Конец слова, начинающегося в position; отмечает управляющие символы в нём
+const char* FindWordEnd(const char* position, const char* end, bool& has_special_symbols) {
+#if defined(__SSE2__)
+    for (; end - position >= static_cast<ptrdiff_t>(VECTOR_SIZE); position += VECTOR_SIZE) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(position));
+        const unsigned space_mask = GetSpaceMask(bytes);
+        const unsigned special_mask = GetSpaceOrSpecialMask(bytes) & ~space_mask;
+        if (space_mask != 0) {
+            const unsigned word_end = static_cast<unsigned>(__builtin_ctz(space_mask));
+            has_special_symbols = has_special_symbols || (special_mask & ((1u << word_end) - 1)) != 0;
+            return position + word_end;
+        }
+        has_special_symbols = has_special_symbols || special_mask != 0;
+    }
+#endif
+    for (; position != end && *position != ' '; ++position) {
+        has_special_symbols = has_special_symbols || IsSpecialSymbol(*position);
+    }
+    return position;
+}
+
+}
+
+void WordTokenizer::Iterator::Advance(const char* position) {
+    const char* word_begin = SkipSpaces(position, end_);
+    word_.has_special_symbols = false;
+    const char* word_end = word_begin == end_ ? end_ : FindWordEnd(word_begin, end_, word_.has_special_symbols);
+    word_.text = string_view(word_begin, static_cast<size_t>(word_end - word_begin));
+}
+
 vector<string_view> SplitIntoWords(string_view text) {
     vector<string_view> words;
-    for (size_t range_begin = text.find_first_not_of(' '); range_begin != string::npos; ) {
-        size_t range_end = text.find_first_of(' ', range_begin + 1);
-        if (range_end == string::npos) {
-            size_t diff = text.size() - range_begin;
-            if (diff > 0) {
-                words.push_back( text.substr(range_begin, diff) );
-            }
-            break;
-        }
-        words.push_back( text.substr(range_begin, range_end - range_begin) );
-        range_begin = text.find_first_not_of(' ', range_end + 1);
+    for (const TextWord & word : WordTokenizer(text)) {
+        words.push_back(word.text);
     }
     return words;
 }
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <iterator>
 #include <set>
 #include <string>
+#include <string_view>
 #include <vector>
 
 template <typename StringContainer>
@@ -15,4 +17,82 @@ std::set<std::string> MakeUniqueNonEmptyStrings(const StringContainer& strings)
     return non_empty_strings;
 }
 
+// Слово текста; has_special_symbols - в слове есть управляющие символы (коды 0-31)
+struct TextWord {
+    std::string_view text;
+    bool has_special_symbols = false;
+};
+
+// Слова текста, разделённые пробелами, без выделения памяти. Разделители
+// и управляющие символы ищутся за один проход, по 16 байт за раз с SSE2,
+// а без него и на последних байтах текста - побайтно.
+class WordTokenizer {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = TextWord;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const TextWord*;
+        using reference = const TextWord&;
+
+        Iterator() = default;
+
+        Iterator(const char* position, const char* end)
+            : end_(end)
+        {
+            Advance(position);
+        }
+
+        reference operator*() const {
+            return word_;
+        }
+
+        pointer operator->() const {
+            return &word_;
+        }
+
+        Iterator& operator++() {
+            Advance(word_.text.data() + word_.text.size());
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator result = *this;
+            ++*this;
+            return result;
+        }
+
+        // итераторы сравниваются по началу слова; конец - пустое слово в конце текста
+        bool operator==(const Iterator& other) const {
+            return word_.text.data() == other.word_.text.data();
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        const char* end_ = nullptr;
+        TextWord word_;
+
+        void Advance(const char* position);
+    };
+
+    explicit WordTokenizer(std::string_view text)
+        : text_(text)
+    {}
+
+    Iterator begin() const {
+        return Iterator(text_.data(), text_.data() + text_.size());
+    }
+
+    Iterator end() const {
+        return Iterator(text_.data() + text_.size(), text_.data() + text_.size());
+    }
+
+private:
+    std::string_view text_;
+};
+
 std::vector<std::string_view> SplitIntoWords(std::string_view text);
@@ -0,0 +1,88 @@
+#include "term_dictionary.h"
+
+#include <algorithm>
+
+using namespace std;
+
+TermDictionary::TermDictionary(const TermDictionary& other)
+    : terms_(other.terms_)
+    , free_term_ids_(other.free_term_ids_)
+{
+    if (other.arena_blocks_.empty()) {
+        term_to_id_ = other.term_to_id_;
+        return;
+    }
+    term_to_id_.reserve(terms_.size());
+    for (TermId term_id = 0; term_id < terms_.size(); ++term_id) {
+        if (!terms_[term_id].empty()) {
+            terms_[term_id] = Store(terms_[term_id]);
+            term_to_id_.emplace(terms_[term_id], term_id);
+        }
+    }
+}
+
+TermId TermDictionary::Intern(string_view term) {
+    auto it = term_to_id_.find(term);
+    if (it != term_to_id_.end()) {
+        return it->second;
+    }
+    const string_view stored = Store(term);
+    TermId term_id;
+    if (free_term_ids_.empty()) {
+        term_id = static_cast<TermId>(terms_.size());
+        terms_.push_back(stored);
+    } else {
+        term_id = free_term_ids_.back();
+        free_term_ids_.pop_back();
+        terms_[term_id] = stored;
+    }
+    term_to_id_.emplace(stored, term_id);
+    return term_id;
+}
+
+TermId TermDictionary::AddStored(string_view term) {
+    const TermId term_id = static_cast<TermId>(terms_.size());
+    terms_.push_back(term);
+    term_to_id_.emplace(term, term_id);
+    return term_id;
+}
+
+void TermDictionary::Erase(TermId term_id) {
+    term_to_id_.erase(terms_[term_id]);
+    terms_[term_id] = {};
+    free_term_ids_.push_back(term_id);
+}
+
+void TermDictionary::AddErased() {
+    free_term_ids_.push_back(static_cast<TermId>(terms_.size()));
+    terms_.emplace_back();
+}
+
+void TermDictionary::Reserve(size_t term_count) {
+    terms_.reserve(term_count);
+    term_to_id_.reserve(term_count);
+}
+
+TermId TermDictionary::Find(string_view term) const {
+    auto it = term_to_id_.find(term);
+    return it == term_to_id_.end() ? NO_TERM : it->second;
+}
+
+string_view TermDictionary::Store(string_view term) {
+    if (term.size() > ARENA_BLOCK_SIZE / 4) {
+        // длинные слова получают собственный блок, чтобы не тратить остаток текущего
+        auto block = make_unique<char[]>(term.size());
+        copy(term.begin(), term.end(), block.get());
+        const string_view stored(block.get(), term.size());
+        arena_blocks_.insert(arena_blocks_.end() - (arena_blocks_.empty() ? 0 : 1), move(block));
+        return stored;
+    }
+    if (ARENA_BLOCK_SIZE - arena_block_used_ < term.size()) {
+        arena_blocks_.push_back(make_unique<char[]>(ARENA_BLOCK_SIZE));
+        arena_block_used_ = 0;
+    }
+    char* dest = arena_blocks_.back().get() + arena_block_used_;
+    copy(term.begin(), term.end(), dest);
+    arena_block_used_ += term.size();
+    return string_view(dest, term.size());
+}
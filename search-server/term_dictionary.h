@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using TermId = uint32_t;
+
+constexpr TermId NO_TERM = std::numeric_limits<TermId>::max();
+
+// Словарь слов: каждому слову назначается плотный TermId, сами строки
+// хранятся в арене и не перемещаются, поэтому string_view на них остаются
+// валидными всё время жизни словаря. Id удалённого слова достаётся
+// следующему новому слову; строка удалённого слова остаётся в арене.
+class TermDictionary {
+public:
+    TermDictionary() = default;
+    // Строки, добавленные AddStored, копии разделяют; если в арене есть
+    // строки, копия складывает их в свою арену и строит таблицу заново
+    TermDictionary(const TermDictionary& other);
+    TermDictionary& operator=(const TermDictionary&) = delete;
+    TermDictionary(TermDictionary&&) = default;
+    TermDictionary& operator=(TermDictionary&&) = default;
+
+    // Возвращает id слова, добавляя его при первом обращении.
+    TermId Intern(std::string_view term);
+
+    // Добавляет новое слово, не копируя строку: она хранится вне словаря
+    // и должна пережить его. Возвращает id слова.
+    TermId AddStored(std::string_view term);
+
+    // Удаляет слово, его id становится свободным
+    void Erase(TermId term_id);
+
+    // Добавляет свободный id, как после Erase
+    void AddErased();
+
+    void Reserve(size_t term_count);
+
+    // Возвращает NO_TERM, если слова нет в словаре.
+    TermId Find(std::string_view term) const;
+
+    // Пустая строка для свободного id
+    std::string_view GetTerm(TermId term_id) const {
+        return terms_[term_id];
+    }
+
+    // Число id, включая свободные
+    size_t size() const {
+        return terms_.size();
+    }
+
+    size_t GetTermCount() const {
+        return terms_.size() - free_term_ids_.size();
+    }
+
+private:
+    static constexpr size_t ARENA_BLOCK_SIZE = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> arena_blocks_;
+    size_t arena_block_used_ = ARENA_BLOCK_SIZE;
+    std::vector<std::string_view> terms_;
+    std::unordered_map<std::string_view, TermId> term_to_id_;
+    std::vector<TermId> free_term_ids_;
+
+    std::string_view Store(std::string_view term);
+};
@@ -11,6 +11,12 @@
 #include <numeric>
 #include <execution>
 #include <random>
+#include <atomic>
+#include <thread>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <array>
 
 #include "document.h"
 #include "search_server.h"
@@ -19,6 +25,12 @@
 #include "remove_duplicates.h"
 #include "log_duration.h"
 #include "process_queries.h"
+#include "thread_pool.h"
+#include "document_bitmap.h"
+#include "document_loader.h"
+#include "string_processing.h"
+#include "query_plan.h"
+#include "snapshot.h"
 
 using namespace std;
 
@@ -291,6 +303,14 @@ void TestMatchingDocuments() {
         ASSERT(query.find(words[0]) != string::npos);
         ASSERT(query.find(words[1]) != string::npos);
     }
+    {
+        // слова возвращаются по алфавиту, а не в порядке появления в индексе
+        SearchServer ordered_server;
+        ordered_server.AddDocument(1, "zebra"s, DocumentStatus::ACTUAL, {1});
+        ordered_server.AddDocument(2, "apple zebra"s, DocumentStatus::ACTUAL, {1});
+        const auto & [words, status] = ordered_server.MatchDocument("zebra apple"s, 2);
+        ASSERT(words == vector<string_view>({"apple"sv, "zebra"sv}));
+    }
 }
 
 // Сортировка найденных документов по релевантности. Возвращаемые при поиске
@@ -526,6 +546,156 @@ void TestCalculationDocumentsRelevancy() {
     }
 }
 
+// Слова запроса, которых нет ни в одном документе, не влияют ни на поиск,
+// ни на матчинг (в том числе отсутствующие минус-слова).
+
+void TestUnknownQueryWords() {
+    SearchServer server("in the"s);
+    server.AddDocument(10, "dog in the city"s, DocumentStatus::ACTUAL, {1, 2, 3});
+    server.AddDocument(11, "cat in the city"s, DocumentStatus::ACTUAL, {4, 1, -3});
+    {
+        const auto found_docs = server.FindTopDocuments("parrot -parrot dog"s);
+        ASSERT_EQUAL(found_docs.size(), 1u);
+        ASSERT_EQUAL(found_docs[0].id, 10);
+    }
+    {
+        const auto & [words, status] = server.MatchDocument("dog city -parrot"s, 10);
+        ASSERT_EQUAL(words.size(), 2u);
+        ASSERT(words[0] == "city"s || words[1] == "city"s);
+    }
+    {
+        const auto & freqs = server.GetWordFrequencies(11);
+        ASSERT_EQUAL(freqs.size(), 2u);
+        ASSERT_EQUAL(freqs.at("cat"s), 0.5);
+    }
+}
+
+// Обход сервера выдаёт внешние id по возрастанию, удалённый документ
+// можно добавить повторно с тем же id, изменения во время обхода его не портят.
+
+void TestDocumentIdsIteration() {
+    SearchServer server;
+    server.AddDocument(5, "white cat"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(1, "black cat"s, DocumentStatus::BANNED, {2});
+    server.AddDocument(3, "grey cat"s, DocumentStatus::ACTUAL, {3});
+    server.RemoveDocument(3);
+    ASSERT_EQUAL(server.GetDocumentCount(), 2);
+    ASSERT((vector<int>(server.begin(), server.end()) == vector<int>{1, 5}));
+
+    server.AddDocument(3, "grey dog"s, DocumentStatus::IRRELEVANT, {4});
+    ASSERT((vector<int>(server.begin(), server.end()) == vector<int>{1, 3, 5}));
+    {
+        const auto found_docs = server.FindTopDocuments("cat"s);
+        ASSERT_EQUAL(found_docs.size(), 1u);
+        ASSERT_EQUAL(found_docs[0].id, 5);
+        ASSERT_EQUAL(found_docs[0].rating, 1);
+    }
+    {
+        const auto found_docs = server.FindTopDocuments("grey"s, DocumentStatus::IRRELEVANT);
+        ASSERT_EQUAL(found_docs.size(), 1u);
+        ASSERT_EQUAL(found_docs[0].id, 3);
+        ASSERT_EQUAL(found_docs[0].rating, 4);
+    }
+    const auto & [words, status] = server.MatchDocument("black cat"s, 1);
+    ASSERT_EQUAL(words.size(), 2u);
+    ASSERT_EQUAL(status, DocumentStatus::BANNED);
+
+    // обход идёт по снятым id, поэтому документы можно удалять прямо в цикле
+    vector<int> visited;
+    for (const int id : server) {
+        visited.push_back(id);
+        server.RemoveDocument(id);
+    }
+    ASSERT((visited == vector<int>{1, 3, 5}));
+    ASSERT_EQUAL(server.GetDocumentCount(), 0);
+    ASSERT(server.begin() == server.end());
+}
+
+// IDF пересчитывается при добавлении и удалении документов; слово, все
+// документы которого удалены, не находится и не ломает поиск.
+
+void TestInverseDocumentFreqAfterRemoval() {
+    SearchServer server;
+    server.AddDocument(1, "cat city"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "dog city"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(3, "parrot"s, DocumentStatus::ACTUAL, {1});
+    {
+        const auto found_docs = server.FindTopDocuments("cat"s);
+        ASSERT_EQUAL(found_docs.size(), 1u);
+        ASSERT_EQUAL(found_docs[0].relevance, 0.5 * log(3.0));
+    }
+    server.RemoveDocument(1);
+    ASSERT(server.FindTopDocuments("cat"s).empty());
+    {
+        const auto found_docs = server.FindTopDocuments("cat dog"s);
+        ASSERT_EQUAL(found_docs.size(), 1u);
+        ASSERT_EQUAL(found_docs[0].id, 2);
+        ASSERT_EQUAL(found_docs[0].relevance, 0.5 * log(2.0));
+    }
+    server.AddDocument(1, "cat"s, DocumentStatus::ACTUAL, {1});
+    {
+        const auto found_docs = server.FindTopDocuments(execution::par, "cat"s);
+        ASSERT_EQUAL(found_docs.size(), 1u);
+        ASSERT_EQUAL(found_docs[0].relevance, log(3.0));
+    }
+}
+
+// Число возвращаемых документов задаётся при вызове; порядок совпадает с
+// полной сортировкой по CompareByRelevance, включая сравнение рейтингов
+// при почти равной релевантности.
+
+void TestFindTopDocumentsMaxCount() {
+    SearchServer server;
+    server.AddDocument(1, "cat"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "cat"s, DocumentStatus::ACTUAL, {5});
+    server.AddDocument(3, "cat dog"s, DocumentStatus::ACTUAL, {9});
+    server.AddDocument(4, "cat"s, DocumentStatus::ACTUAL, {3});
+    server.AddDocument(5, "cat dog parrot"s, DocumentStatus::ACTUAL, {7});
+    server.AddDocument(6, "cat"s, DocumentStatus::ACTUAL, {4});
+    server.AddDocument(7, "cat"s, DocumentStatus::ACTUAL, {2});
+    server.AddDocument(8, "dog"s, DocumentStatus::ACTUAL, {1});
+
+    ASSERT_EQUAL(server.FindTopDocuments("cat"s).size(), 5u);
+    ASSERT(server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, 0).empty());
+
+    const auto all_docs = server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, 100);
+    ASSERT_EQUAL(all_docs.size(), 7u);
+    const vector<int> expected_ids = {2, 6, 4, 7, 1, 3, 5};
+    for (size_t i = 0; i < all_docs.size(); ++i) {
+        ASSERT_EQUAL(all_docs[i].id, expected_ids[i]);
+    }
+    for (size_t max_count = 1; max_count <= all_docs.size(); ++max_count) {
+        const auto found_docs = server.FindTopDocuments(execution::par, "cat"s, [](int, DocumentStatus, int) { return true; }, max_count);
+        ASSERT_EQUAL(found_docs.size(), max_count);
+        for (size_t i = 0; i < max_count; ++i) {
+            ASSERT_EQUAL(found_docs[i].id, all_docs[i].id);
+        }
+    }
+}
+
+// Накопители релевантности переиспользуются между запросами одного потока:
+// повторные и вложенные (из предиката) запросы не видят чужих оценок.
+
+void TestRepeatedAndNestedQueries() {
+    SearchServer server;
+    server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "black cat"s, DocumentStatus::ACTUAL, {2});
+    server.AddDocument(3, "black dog"s, DocumentStatus::ACTUAL, {3});
+
+    const auto expected = server.FindTopDocuments("cat -white"s);
+    ASSERT_EQUAL(expected.size(), 1u);
+    ASSERT_EQUAL(expected[0].id, 2);
+    ASSERT_EQUAL(server.FindTopDocuments("cat"s).size(), 2u);
+
+    const auto found_docs = server.FindTopDocuments("black"s, [&server](int document_id, DocumentStatus, int) {
+        const auto nested = server.FindTopDocuments("cat -white"s);
+        return nested.size() == 1 && nested[0].id == document_id;
+    });
+    ASSERT_EQUAL(found_docs.size(), 1u);
+    ASSERT_EQUAL(found_docs[0].id, 2);
+    ASSERT_EQUAL(server.FindTopDocuments("cat -white"s)[0].relevance, expected[0].relevance);
+}
+
 // Функция TestSearchServer является точкой входа для запуска тестов
 void TestSearchServer() {
     RUN_TEST(TestExcludeStopWordsFromAddedDocumentContent);
@@ -537,6 +707,11 @@ void TestSearchServer() {
     RUN_TEST(TestUsageDocumentsPredicate);
     RUN_TEST(TestFindByStatus);
     RUN_TEST(TestCalculationDocumentsRelevancy);
+    RUN_TEST(TestUnknownQueryWords);
+    RUN_TEST(TestDocumentIdsIteration);
+    RUN_TEST(TestInverseDocumentFreqAfterRemoval);
+    RUN_TEST(TestFindTopDocumentsMaxCount);
+    RUN_TEST(TestRepeatedAndNestedQueries);
 }
 
 void TestProcessQueries() {
@@ -843,6 +1018,1314 @@ vector<string> GenerateQueries(mt19937& generator, const vector<string>& diction
     return queries;
 }
 
+// Совпадение результатов поиска вплоть до релевантности и рейтинга
+void AssertSameDocuments(const vector<Document>& expected, const vector<Document>& actual) {
+    ASSERT_EQUAL(actual.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        ASSERT_EQUAL(actual[i].id, expected[i].id);
+        ASSERT(actual[i].relevance == expected[i].relevance);
+        ASSERT_EQUAL(actual[i].rating, expected[i].rating);
+    }
+}
+
+// Параллельный поиск и поиск с отсечением WAND возвращают в точности те же
+// документы, что и последовательный полный перебор, при любых K, длине запроса,
+// минус-словах, статусах и удалённых документах.
+
+void TestSearchEnginesMatchSequential() {
+    // несколько рабочих потоков, чтобы параллельный поиск делил документы
+    // на диапазоны даже на одноядерной машине
+    SetThreadPoolSize(3);
+    mt19937 generator;
+
+    const auto dictionary = GenerateDictionary(generator, 300, 6);
+    const auto documents = GenerateQueries(generator, dictionary, 4'000, 40);
+
+    SearchServer search_server(dictionary[0]);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const auto status = static_cast<DocumentStatus>(uniform_int_distribution(0, 2)(generator));
+        search_server.AddDocument(i, documents[i], status, {uniform_int_distribution(-5, 5)(generator)});
+    }
+    for (int i = 0; i < 4'000; i += 7) {
+        search_server.RemoveDocument(i);
+    }
+
+    vector<string> queries;
+    for (int i = 0; i < 300; ++i) {
+        queries.push_back(GenerateQuery(generator, dictionary, uniform_int_distribution(1, 16)(generator), 0.1));
+    }
+    // длинные запросы: большая часть слов становится необязательной
+    for (int i = 0; i < 30; ++i) {
+        queries.push_back(GenerateQuery(generator, dictionary, uniform_int_distribution(40, 80)(generator), 0.05));
+    }
+    for (const string& query : queries) {
+        for (size_t max_count : {1u, 5u, 20u}) {
+            AssertSameDocuments(search_server.FindTopDocuments(execution::seq, query, DocumentStatus::ACTUAL, max_count),
+                                search_server.FindTopDocuments(search_engine::wand, query, DocumentStatus::ACTUAL, max_count));
+        }
+        for (size_t max_count : {1u, 5u, 20u}) {
+            AssertSameDocuments(search_server.FindTopDocuments(execution::seq, query, DocumentStatus::ACTUAL, max_count),
+                                search_server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, max_count));
+        }
+        // отбор по статусу через множества документов совпадает с вызовом предиката
+        for (const DocumentStatus status : {DocumentStatus::ACTUAL, DocumentStatus::BANNED, DocumentStatus::REMOVED}) {
+            auto has_status = [status](int, DocumentStatus document_status, int) { return document_status == status; };
+            const auto expected = search_server.FindTopDocuments(execution::seq, query, has_status);
+            AssertSameDocuments(expected, search_server.FindTopDocuments(execution::seq, query, status));
+            AssertSameDocuments(expected, search_server.FindTopDocuments(execution::par, query, status));
+            AssertSameDocuments(expected, search_server.FindTopDocuments(search_engine::wand, query, status));
+        }
+        auto even_rating = [](int, DocumentStatus, int rating) { return rating % 2 == 0; };
+        AssertSameDocuments(search_server.FindTopDocuments(execution::seq, query, even_rating),
+                            search_server.FindTopDocuments(search_engine::wand, query, even_rating));
+    }
+    SetThreadPoolSize(max(1u, thread::hardware_concurrency()) - 1);
+}
+
+// Множество номеров документов: разреженные и плотные фрагменты,
+// переходы между ними при добавлении и удалении.
+
+void TestDocumentBitmap() {
+    DocumentBitmap bitmap;
+    ASSERT(bitmap.empty());
+    ASSERT_EQUAL(bitmap.NextAtLeast(0), NO_DOCUMENT);
+
+    set<DocumentOrdinal> expected;
+    mt19937 generator;
+    // первый фрагмент станет плотным, второй и третий останутся разреженными
+    for (int i = 0; i < 6'000; ++i) {
+        expected.insert(uniform_int_distribution<DocumentOrdinal>(0, 20'000)(generator));
+    }
+    for (int i = 0; i < 100; ++i) {
+        expected.insert(uniform_int_distribution<DocumentOrdinal>(65'536, 140'000)(generator));
+    }
+    expected.insert(NO_DOCUMENT - 1);
+    for (const DocumentOrdinal ordinal : expected) {
+        bitmap.Add(ordinal);
+    }
+    bitmap.Add(*expected.begin());
+    ASSERT_EQUAL(bitmap.size(), expected.size());
+
+    auto check = [&bitmap, &expected, &generator]() {
+        ASSERT_EQUAL(bitmap.size(), expected.size());
+        for (int i = 0; i < 2'000; ++i) {
+            const auto ordinal = uniform_int_distribution<DocumentOrdinal>(0, 150'000)(generator);
+            ASSERT_EQUAL(bitmap.Contains(ordinal), expected.count(ordinal) > 0);
+            const auto it = expected.lower_bound(ordinal);
+            ASSERT_EQUAL(bitmap.NextAtLeast(ordinal), it == expected.end() ? NO_DOCUMENT : *it);
+        }
+        ASSERT_EQUAL(bitmap.NextAtLeast(150'001), NO_DOCUMENT - 1);
+    };
+    check();
+
+    // удаление возвращает плотный фрагмент к массиву
+    for (auto it = expected.begin(); it != expected.end() && *it < 20'000;) {
+        if (*it % 3 != 0) {
+            ASSERT(bitmap.Remove(*it));
+            it = expected.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    ASSERT(!bitmap.Remove(1));
+    check();
+
+    // пустые фрагменты удаляются
+    for (auto it = expected.begin(); it != expected.end() && *it < 65'536;) {
+        ASSERT(bitmap.Remove(*it));
+        it = expected.erase(it);
+    }
+    check();
+}
+
+// Сегменты и их объединение не меняют результатов: сервер сравнивается
+// с индексом, в котором все документы остаются в буфере.
+
+void TestIndexSegments() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 500, 6);
+    const auto documents = GenerateQueries(generator, dictionary, 6'000, 20);
+
+    SearchServer server;
+    SearchIndex buffer_only;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const int id = static_cast<int>(i) * 2;
+        const auto status = i % 10 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL;
+        server.AddDocument(id, documents[i], status, {static_cast<int>(i % 7)});
+        buffer_only.AddDocument(id, documents[i], status, {static_cast<int>(i % 7)});
+    }
+    ASSERT(server.GetSegmentCount() > 0);
+    ASSERT_EQUAL(buffer_only.GetSegmentCount(), 0u);
+    for (int id = 0; id < 12'000; id += 6) {
+        server.RemoveDocument(id);
+        buffer_only.RemoveDocument(id);
+    }
+
+    vector<string> queries;
+    for (int i = 0; i < 100; ++i) {
+        queries.push_back(GenerateQuery(generator, dictionary, 5, 0.2));
+    }
+    auto check = [&server, &buffer_only, &queries]() {
+        ASSERT_EQUAL(server.GetDocumentCount(), buffer_only.GetDocumentCount());
+        for (const string& query : queries) {
+            for (const DocumentStatus status : {DocumentStatus::ACTUAL, DocumentStatus::BANNED}) {
+                const auto expected = buffer_only.FindTopDocuments(query, status, 10);
+                for (const auto& actual : {server.FindTopDocuments(execution::seq, query, status, 10),
+                                           server.FindTopDocuments(search_engine::wand, query, status, 10)}) {
+                    AssertSameDocuments(expected, actual);
+                }
+            }
+            ASSERT(get<0>(server.MatchDocument(query, 4)) == get<0>(buffer_only.MatchDocument(query, 4)));
+        }
+    };
+    check();
+
+    server.MergeSegments();
+    ASSERT(server.GetSegmentCount() < SearchIndex::MERGE_FACTOR);
+    check();
+}
+
+// Удалённые документы остаются в сегментах метками и вычищаются при
+// построении сегмента из буфера и при уплотнении сегмента; их порядковые
+// номера при этом освобождаются, а номера следующих документов сдвигаются.
+
+void TestTombstoneCompaction() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 300, 6);
+    const auto documents = GenerateQueries(generator, dictionary, 3'000, 15);
+
+    SearchIndex index;
+    SearchIndex buffer_only;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const int id = static_cast<int>(i);
+        index.AddDocument(id, documents[i], DocumentStatus::ACTUAL, {id % 5});
+        buffer_only.AddDocument(id, documents[i], DocumentStatus::ACTUAL, {id % 5});
+        if (index.IsBufferFull()) {
+            index.FlushBuffer(index.BuildBufferSegment());
+        }
+        // удалённые из буфера документы в сегмент не попадают
+        if (i % 10 == 0) {
+            index.RemoveDocument(id);
+            buffer_only.RemoveDocument(id);
+        }
+    }
+    ASSERT_EQUAL(index.GetSegmentCount(), 2u);
+    ASSERT(!index.NeedsCompaction());
+    ASSERT(!index.PlanSegmentMerge());
+
+    // удаляем половину документов первого сегмента
+    for (int id = 1; id < static_cast<int>(SearchIndex::BUFFER_DOCUMENT_COUNT); id += 2) {
+        index.RemoveDocument(id);
+        buffer_only.RemoveDocument(id);
+    }
+    ASSERT(index.NeedsCompaction());
+    const size_t tombstone_count = index.GetTombstoneCount();
+
+    vector<string> queries;
+    for (int i = 0; i < 50; ++i) {
+        queries.push_back(GenerateQuery(generator, dictionary, 4, 0.2));
+    }
+    auto check = [&index, &buffer_only, &queries]() {
+        ASSERT_EQUAL(index.GetDocumentCount(), buffer_only.GetDocumentCount());
+        ASSERT(vector<int>(index.begin(), index.end()) == vector<int>(buffer_only.begin(), buffer_only.end()));
+        for (const string& query : queries) {
+            const auto expected = buffer_only.FindTopDocuments(query);
+            for (const auto& actual : {index.FindTopDocuments(query),
+                                       index.FindTopDocuments(search_engine::wand, query)}) {
+                AssertSameDocuments(expected, actual);
+            }
+            for (const DocumentStatus status : {DocumentStatus::ACTUAL, DocumentStatus::BANNED}) {
+                AssertSameDocuments(buffer_only.FindTopDocuments(query, status), index.FindTopDocuments(query, status));
+            }
+        }
+        for (const int id : buffer_only) {
+            ASSERT(index.GetWordFrequencies(id) == buffer_only.GetWordFrequencies(id));
+        }
+    };
+    check();
+
+    const auto merge = index.PlanSegmentMerge();
+    ASSERT(merge);
+    ASSERT_EQUAL(merge->segments.size(), 1u);
+    index.ReplaceSegments(*merge, IndexSegment::Merge(merge->segments, merge->removed_ordinals));
+    ASSERT_EQUAL(index.GetSegmentCount(), 2u);
+    ASSERT_EQUAL(index.GetTombstoneCount(), tombstone_count - merge->removed_ordinals.size());
+    ASSERT(!index.NeedsCompaction());
+    ASSERT(!index.PlanSegmentMerge());
+    check();
+
+    // номера заняты только документами и метками удалённых; повторно
+    // добавленный документ получает новый номер
+    const size_t ordinal_count = index.GetOrdinalCount();
+    ASSERT_EQUAL(ordinal_count, static_cast<size_t>(index.GetDocumentCount()) + index.GetTombstoneCount());
+    ASSERT(ordinal_count < documents.size());
+    for (SearchIndex* target : {&index, &buffer_only}) {
+        target->RemoveDocument(2);
+        target->AddDocument(2, documents[2], DocumentStatus::ACTUAL, {2});
+    }
+    ASSERT_EQUAL(index.GetOrdinalCount(), ordinal_count + 1);
+    check();
+
+    // буфер, сдвинутый уплотнением, становится сегментом с верными номерами
+    for (size_t i = 0; !index.IsBufferFull(); ++i) {
+        const int id = static_cast<int>(documents.size() + i);
+        const auto status = i % 3 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL;
+        for (SearchIndex* target : {&index, &buffer_only}) {
+            target->AddDocument(id, documents[i], status, {1});
+        }
+    }
+    index.FlushBuffer(index.BuildBufferSegment());
+    ASSERT_EQUAL(index.GetSegmentCount(), 3u);
+    check();
+}
+
+// Слова без документов удаляются из словаря, когда вычищается их последнее
+// вхождение, а освободившиеся id достаются новым словам.
+
+void TestDeadTermErasure() {
+    const int document_count = static_cast<int>(SearchIndex::BUFFER_DOCUMENT_COUNT);
+    SearchIndex index;
+    for (int id = 0; id < document_count; ++id) {
+        index.AddDocument(id, "common unique"s + to_string(id), DocumentStatus::ACTUAL, {1});
+    }
+    ASSERT_EQUAL(index.GetTermCount(), static_cast<size_t>(document_count) + 1);
+
+    // вхождения удалённого из буфера документа не попадают в сегмент
+    index.RemoveDocument(0);
+    ASSERT_EQUAL(index.GetTermCount(), static_cast<size_t>(document_count) + 1);
+    index.FlushBuffer(index.BuildBufferSegment());
+    ASSERT_EQUAL(index.GetTermCount(), static_cast<size_t>(document_count));
+
+    // вхождения документов сегмента остаются до уплотнения
+    for (int id = 1; id < document_count; id += 2) {
+        index.RemoveDocument(id);
+    }
+    ASSERT_EQUAL(index.GetTermCount(), static_cast<size_t>(document_count));
+    const uint64_t query_generation = index.GetQueryGeneration();
+    const auto merge = index.PlanSegmentMerge();
+    ASSERT(merge);
+    index.ReplaceSegments(*merge, IndexSegment::Merge(merge->segments, merge->removed_ordinals));
+    ASSERT_EQUAL(index.GetTermCount(), static_cast<size_t>(document_count / 2));
+    ASSERT(index.GetQueryGeneration() > query_generation);
+    ASSERT(index.FindTopDocuments("unique1"s).empty());
+    ASSERT_EQUAL(index.FindTopDocuments("unique2"s).size(), 1u);
+
+    index.AddDocument(document_count, "fresh unique1"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(index.GetTermCount(), static_cast<size_t>(document_count / 2) + 2);
+    ASSERT_EQUAL(index.FindTopDocuments("unique1"s).size(), 1u);
+    ASSERT_EQUAL(index.FindTopDocuments("fresh"s).size(), 1u);
+
+    // свободные id переживают снимок
+    const string path = (filesystem::temp_directory_path() / "search_server_test_dead_terms.snapshot"s).string();
+    index.SaveSnapshot(path);
+    {
+        const SearchIndex opened = SearchIndex::OpenSnapshot(SnapshotReader(make_shared<const MappedFile>(path)));
+        ASSERT_EQUAL(opened.GetTermCount(), index.GetTermCount());
+        for (const string query : {"common"s, "unique1"s, "unique3"s, "unique4"s, "fresh"s}) {
+            AssertSameDocuments(index.FindTopDocuments(query), opened.FindTopDocuments(query));
+        }
+    }
+    filesystem::remove(path);
+}
+
+// Пакетное добавление даёт тот же индекс и те же ошибки, что и добавление
+// документов по одному.
+
+void TestAddDocumentsMatchSequential() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 400, 6);
+    const auto texts = GenerateQueries(generator, dictionary, 3'000, 15);
+    const string invalid_text = "bad wo\x12rd"s;
+
+    vector<NewDocument> documents;
+    for (size_t i = 0; i < texts.size(); ++i) {
+        const auto status = i % 7 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL;
+        documents.push_back({static_cast<int>(i) * 3, texts[i], status, {static_cast<int>(i % 5), 3}});
+    }
+    documents[1'500].id = documents[100].id;
+    documents[2'100].id = -1;
+    documents[2'700].text = invalid_text;
+
+    SearchServer sequential(dictionary[0]);
+    vector<string> expected_errors;
+    for (const NewDocument & document : documents) {
+        try {
+            sequential.AddDocument(document.id, document.text, document.status, document.ratings);
+        } catch (const invalid_argument& e) {
+            expected_errors.push_back(e.what());
+        }
+    }
+    ASSERT_EQUAL(expected_errors.size(), 3u);
+
+    // после ошибки пакет добавляется дальше со следующего за ошибочным документа
+    auto add_in_batches = [&documents](auto & target, auto policy) {
+        vector<string> errors;
+        for (size_t first = 0; first < documents.size();) {
+            const vector<NewDocument> rest(documents.begin() + first, documents.end());
+            const int count_before = target.GetDocumentCount();
+            try {
+                target.AddDocuments(policy, rest);
+                first = documents.size();
+            } catch (const invalid_argument& e) {
+                errors.push_back(e.what());
+                first += target.GetDocumentCount() - count_before + 1;
+            }
+        }
+        return errors;
+    };
+    SearchServer batched(dictionary[0]);
+    SearchIndex batched_index(dictionary[0]);
+    ASSERT(add_in_batches(batched, execution::par) == expected_errors);
+    ASSERT(add_in_batches(batched_index, execution::seq) == expected_errors);
+
+    const auto queries = GenerateQueries(generator, dictionary, 50, 4);
+    ASSERT_EQUAL(batched.GetDocumentCount(), sequential.GetDocumentCount());
+    ASSERT_EQUAL(batched_index.GetDocumentCount(), sequential.GetDocumentCount());
+    for (const string& query : queries) {
+        const auto expected = sequential.FindTopDocuments(query);
+        for (const auto& actual : {batched.FindTopDocuments(query), batched_index.FindTopDocuments(query)}) {
+            AssertSameDocuments(expected, actual);
+        }
+    }
+    for (const int id : sequential) {
+        ASSERT(batched.GetWordFrequencies(id) == sequential.GetWordFrequencies(id));
+        ASSERT(batched_index.GetWordFrequencies(id) == sequential.GetWordFrequencies(id));
+    }
+}
+
+// Пакетное удаление оставляет индекс таким же, как удаление по одному;
+// повторные и отсутствующие id пропускаются.
+
+void TestRemoveDocumentsMatchSequential() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 300, 6);
+    const auto texts = GenerateQueries(generator, dictionary, 2'500, 15);
+
+    SearchServer sequential;
+    SearchServer batched;
+    for (size_t i = 0; i < texts.size(); ++i) {
+        const auto status = i % 5 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL;
+        sequential.AddDocument(static_cast<int>(i), texts[i], status, {static_cast<int>(i % 9)});
+        batched.AddDocument(static_cast<int>(i), texts[i], status, {static_cast<int>(i % 9)});
+    }
+
+    vector<int> ids;
+    for (int id = 0; id < 2'500; id += 3) {
+        ids.push_back(id);
+    }
+    ids.push_back(3);
+    ids.push_back(-1);
+    ids.push_back(100'000);
+    for (const int id : ids) {
+        sequential.RemoveDocument(id);
+    }
+    batched.RemoveDocuments(execution::par, {ids.begin(), ids.begin() + 400});
+    batched.RemoveDocuments(execution::seq, {ids.begin() + 400, ids.end()});
+
+    ASSERT_EQUAL(batched.GetDocumentCount(), sequential.GetDocumentCount());
+    ASSERT(vector<int>(batched.begin(), batched.end()) == vector<int>(sequential.begin(), sequential.end()));
+    for (const string& query : GenerateQueries(generator, dictionary, 50, 4)) {
+        for (const DocumentStatus status : {DocumentStatus::ACTUAL, DocumentStatus::BANNED}) {
+            const auto expected = sequential.FindTopDocuments(query, status);
+            const auto actual = batched.FindTopDocuments(query, status);
+            AssertSameDocuments(expected, actual);
+        }
+    }
+}
+
+// Сервер, открытый из снимка, отвечает так же, как записавший его, и
+// продолжает принимать изменения. Повреждённый снимок не открывается.
+
+void TestSnapshot() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 400, 6);
+    const auto texts = GenerateQueries(generator, dictionary, 2'500, 15);
+    const string path = (filesystem::temp_directory_path() / "search_server_test.snapshot"s).string();
+
+    SearchServer original(dictionary[0] + " "s + dictionary[1]);
+    for (size_t i = 0; i < texts.size(); ++i) {
+        const auto status = i % 4 == 0 ? DocumentStatus::IRRELEVANT : DocumentStatus::ACTUAL;
+        original.AddDocument(static_cast<int>(i) * 2, texts[i], status, {static_cast<int>(i % 11), -2});
+    }
+    for (int id = 0; id < 5'000; id += 14) {
+        original.RemoveDocument(id);
+    }
+    original.SaveSnapshot(path);
+    SearchServer opened = SearchServer::OpenSnapshot(path);
+
+    const auto queries = GenerateQueries(generator, dictionary, 50, 4);
+    auto check = [&original, &queries](const SearchServer & opened) {
+        ASSERT_EQUAL(opened.GetDocumentCount(), original.GetDocumentCount());
+        ASSERT(vector<int>(opened.begin(), opened.end()) == vector<int>(original.begin(), original.end()));
+        for (const string& query : queries) {
+            for (const DocumentStatus status : {DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT}) {
+                const auto expected = original.FindTopDocuments(query, status);
+                for (const auto& actual : {opened.FindTopDocuments(execution::seq, query, status),
+                                           opened.FindTopDocuments(execution::par, query, status),
+                                           opened.FindTopDocuments(search_engine::wand, query, status)}) {
+                    AssertSameDocuments(expected, actual);
+                }
+            }
+            ASSERT(opened.MatchDocument(query, 6) == original.MatchDocument(query, 6));
+        }
+        for (const int id : original) {
+            ASSERT(opened.GetWordFrequencies(id) == original.GetWordFrequencies(id));
+        }
+    };
+    check(opened);
+
+    // без позиции журнала неизвестно, с какого файла его применять, и такой
+    // снимок не открывается
+    const string directory = (filesystem::temp_directory_path() / "search_server_test_no_log_position"s).string();
+    filesystem::remove_all(directory);
+    filesystem::create_directories(directory);
+    {
+        const SnapshotReader reader(make_shared<const MappedFile>(path));
+        SnapshotWriter writer((filesystem::path(directory) / "index.snapshot"s).string());
+        for (uint32_t kind = 0; kind <= static_cast<uint32_t>(SnapshotSectionKind::REMOVED_DOCUMENTS); ++kind) {
+            if (kind == static_cast<uint32_t>(SnapshotSectionKind::LOG_POSITION)) {
+                continue;
+            }
+            for (const auto section : reader.GetSections(static_cast<SnapshotSectionKind>(kind))) {
+                writer.BeginSection(static_cast<SnapshotSectionKind>(kind));
+                writer.Write(section.data, section.size);
+                writer.EndSection();
+            }
+        }
+        writer.Finish();
+    }
+    try {
+        SearchServer::OpenDurable(directory);
+        ASSERT(false);
+    } catch (const runtime_error&) {
+    }
+    filesystem::remove_all(directory);
+
+    for (SearchServer* server : {&original, &opened}) {
+        server->AddDocument(100'001, dictionary[5] + " "s + dictionary[7], DocumentStatus::ACTUAL, {9});
+        server->RemoveDocument(2);
+        server->MergeSegments();
+    }
+    check(opened);
+
+    // статус REMOVED, заданный пользователем, не означает удаления документа
+    {
+        SearchServer server;
+        server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, {1});
+        server.AddDocument(2, "black cat"s, DocumentStatus::REMOVED, {2});
+        server.AddDocument(3, "grey cat"s, DocumentStatus::REMOVED, {3});
+        server.RemoveDocument(3);
+        const string status_path = path + ".status"s;
+        server.SaveSnapshot(status_path);
+        SearchServer reopened = SearchServer::OpenSnapshot(status_path);
+        ASSERT_EQUAL(reopened.GetDocumentCount(), 2);
+        ASSERT((vector<int>(reopened.begin(), reopened.end()) == vector<int>{1, 2}));
+        AssertSameDocuments(server.FindTopDocuments("cat"s, DocumentStatus::REMOVED),
+                            reopened.FindTopDocuments("cat"s, DocumentStatus::REMOVED));
+        ASSERT_EQUAL(reopened.FindTopDocuments("cat"s, DocumentStatus::REMOVED).size(), 1u);
+        filesystem::remove(status_path);
+    }
+
+    // контрольная сумма секции проверяется, когда секцию читают: позиция
+    // журнала читается из снимка с повреждённой секцией оценок, а без проверки
+    // сумм такой снимок открывается
+    {
+        size_t ratings_offset;
+        {
+            const auto file = make_shared<const MappedFile>(path);
+            ratings_offset = SnapshotReader(file).GetSection(SnapshotSectionKind::DOCUMENT_RATINGS).data - file->data();
+        }
+        auto flip_byte = [&path](size_t offset) {
+            fstream file(path, ios::in | ios::out | ios::binary);
+            file.seekg(static_cast<streamoff>(offset));
+            const char byte = static_cast<char>(file.get());
+            file.seekp(static_cast<streamoff>(offset));
+            file.put(static_cast<char>(byte ^ 1));
+        };
+        flip_byte(ratings_offset);
+        const SnapshotReader reader(make_shared<const MappedFile>(path));
+        ASSERT_EQUAL(SearchIndex::GetSnapshotLogPosition(reader), 0u);
+        try {
+            SearchIndex::OpenSnapshot(reader);
+            ASSERT(false);
+        } catch (const runtime_error&) {
+        }
+        const SnapshotReader unverified(make_shared<const MappedFile>(path), false);
+        const SearchIndex unverified_index = SearchIndex::OpenSnapshot(unverified);
+        flip_byte(ratings_offset);
+        ASSERT_EQUAL(unverified_index.GetDocumentCount(), SearchServer::OpenSnapshot(path).GetDocumentCount());
+    }
+
+    // повреждённый байт в середине файла
+    {
+        fstream file(path, ios::in | ios::out | ios::binary);
+        file.seekg(1'000);
+        const char byte = static_cast<char>(file.get());
+        file.seekp(1'000);
+        file.put(static_cast<char>(byte ^ 1));
+    }
+    bool caught = false;
+    try {
+        SearchServer::OpenSnapshot(path);
+    } catch (const runtime_error&) {
+        caught = true;
+    }
+    ASSERT(caught);
+    filesystem::remove(path);
+}
+
+// Сервер, открытый OpenDurable, после перезапуска восстанавливает все
+// подтверждённые изменения из снимка и журнала, включая ошибочные изменения
+// и недописанную запись в конце журнала.
+
+void TestWriteAheadLog() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 300, 6);
+    const auto texts = GenerateQueries(generator, dictionary, 3'000, 12);
+    const string directory = (filesystem::temp_directory_path() / "search_server_test_wal"s).string();
+    filesystem::remove_all(directory);
+
+    SearchServer expected(dictionary[0]);
+    auto apply = [&](SearchServer & server, size_t first, size_t last) {
+        vector<NewDocument> documents;
+        for (size_t i = first; i < last; ++i) {
+            if (i % 3 == 0) {
+                server.AddDocument(static_cast<int>(i), texts[i], DocumentStatus::ACTUAL, {static_cast<int>(i % 7)});
+            } else {
+                documents.push_back({static_cast<int>(i), texts[i], DocumentStatus::BANNED, {1, 2}});
+            }
+        }
+        server.AddDocuments(documents);
+        try {
+            server.AddDocument(static_cast<int>(first), texts[first], DocumentStatus::ACTUAL, {});
+        } catch (const invalid_argument&) {
+        }
+        server.RemoveDocument(static_cast<int>(first) + 1);
+        server.RemoveDocuments({static_cast<int>(first) + 4, static_cast<int>(first) + 5, -1});
+    };
+    auto check = [&expected, &dictionary](const SearchServer & server) {
+        ASSERT_EQUAL(server.GetDocumentCount(), expected.GetDocumentCount());
+        ASSERT(vector<int>(server.begin(), server.end()) == vector<int>(expected.begin(), expected.end()));
+        for (size_t i = 0; i < 40; ++i) {
+            const string query = dictionary[i] + " "s + dictionary[i + 40];
+            for (const DocumentStatus status : {DocumentStatus::ACTUAL, DocumentStatus::BANNED}) {
+                const auto expected_documents = expected.FindTopDocuments(query, status);
+                const auto actual = server.FindTopDocuments(query, status);
+                AssertSameDocuments(expected_documents, actual);
+            }
+        }
+    };
+    auto count_log_files = [&directory]() {
+        size_t count = 0;
+        for (const auto & entry : filesystem::directory_iterator(directory)) {
+            count += entry.path().extension() == ".log"s ? 1 : 0;
+        }
+        return count;
+    };
+
+    apply(expected, 0, 1'000);
+    apply(expected, 1'000, 3'000);
+    {
+        SearchServer server = SearchServer::OpenDurable(directory);
+        server.SetStopWords(dictionary[0]);
+        apply(server, 0, 1'000);
+    }
+    {
+        // только журнал, без снимка
+        SearchServer server = SearchServer::OpenDurable(directory);
+        server.Checkpoint();
+        ASSERT_EQUAL(count_log_files(), 1u);
+        apply(server, 1'000, 3'000);
+        check(server);
+    }
+
+    // запись, оборванная при падении, отбрасывается
+    string last_log;
+    for (const auto & entry : filesystem::directory_iterator(directory)) {
+        if (entry.path().extension() == ".log"s && entry.path().string() > last_log) {
+            last_log = entry.path().string();
+        }
+    }
+    {
+        ofstream file(last_log, ios::binary | ios::app);
+        file.write("\x30\0\0\0\x01\x02", 6);
+    }
+    {
+        SearchServer server = SearchServer::OpenDurable(directory);
+        check(server);
+        server.AddDocument(10'000, dictionary[3], DocumentStatus::ACTUAL, {5});
+    }
+    expected.AddDocument(10'000, dictionary[3], DocumentStatus::ACTUAL, {5});
+    check(SearchServer::OpenDurable(directory));
+
+    // пакет с ошибочным документом: после восстановления добавлены только
+    // документы до ошибки, как и в сервере до перезапуска
+    const vector<NewDocument> bad_batch = {{20'001, dictionary[4], DocumentStatus::ACTUAL, {1}},
+                                           {20'002, dictionary[5] + "\x01"s, DocumentStatus::ACTUAL, {2}},
+                                           {20'003, dictionary[6], DocumentStatus::ACTUAL, {3}}};
+    auto add_bad_batch = [&bad_batch](SearchServer & server) {
+        try {
+            server.AddDocuments(bad_batch);
+        } catch (const invalid_argument&) {
+        }
+    };
+    add_bad_batch(expected);
+    {
+        SearchServer server = SearchServer::OpenDurable(directory);
+        add_bad_batch(server);
+        check(server);
+    }
+    ASSERT(find(expected.begin(), expected.end(), 20'001) != expected.end());
+    ASSERT(find(expected.begin(), expected.end(), 20'003) == expected.end());
+    check(SearchServer::OpenDurable(directory));
+
+    // стоп-слова перед ошибочным словом остаются добавленными и после восстановления
+    const string bad_stop_words = dictionary[7] + " "s + dictionary[8] + "\x01 "s + dictionary[9];
+    auto set_bad_stop_words = [&bad_stop_words](SearchServer & server) {
+        try {
+            server.SetStopWords(bad_stop_words);
+        } catch (const invalid_argument&) {
+        }
+    };
+    set_bad_stop_words(expected);
+    {
+        SearchServer server = SearchServer::OpenDurable(directory);
+        set_bad_stop_words(server);
+        check(server);
+    }
+    ASSERT(expected.FindTopDocuments(dictionary[7]).empty());
+    check(SearchServer::OpenDurable(directory));
+    filesystem::remove_all(directory);
+
+    // недописанная запись в конце файла пропускается, а отрезает её только
+    // новый журнал; плохая запись, за которой идут целые, - повреждение
+    auto write_records = [&directory]() {
+        filesystem::remove_all(directory);
+        WriteAheadLog wal(directory, {});
+        for (int document_id = 1; document_id <= 3; ++document_id) {
+            wal.Commit(wal.AppendRemoveDocument(document_id));
+        }
+    };
+    auto replay = [&directory]() {
+        vector<int> document_ids;
+        WriteAheadLog::Replay(directory, 0, [&document_ids](const LogRecord & record) {
+            document_ids.push_back(record.document_id);
+        });
+        return document_ids;
+    };
+    auto first_log = [&directory]() {
+        for (const auto & entry : filesystem::directory_iterator(directory)) {
+            if (entry.path().extension() == ".log"s) {
+                return entry.path();
+            }
+        }
+        return filesystem::path{};
+    };
+    write_records();
+    const auto log_size = filesystem::file_size(first_log());
+    filesystem::resize_file(first_log(), log_size - 1);
+    ASSERT(replay() == vector<int>({1, 2}));
+    ASSERT_EQUAL(filesystem::file_size(first_log()), log_size - 1);
+    {
+        WriteAheadLog wal(directory, {});
+    }
+    ASSERT_EQUAL(filesystem::file_size(first_log()), log_size / 3 * 2);
+    ASSERT(replay() == vector<int>({1, 2}));
+
+    write_records();
+    {
+        fstream file(first_log(), ios::binary | ios::in | ios::out);
+        file.seekp(static_cast<streamoff>(log_size / 3 + 9));
+        file.put('\x7f');
+    }
+    try {
+        replay();
+        ASSERT(false);
+    } catch (const runtime_error&) {
+    }
+    filesystem::remove_all(directory);
+}
+
+// Загрузка из потока даёт тот же индекс, что и добавление по одному, при
+// любом размере блока; документы до ошибочной строки остаются добавленными.
+
+void TestLoadDocuments() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 300, 8);
+    const auto texts = GenerateQueries(generator, dictionary, 1'000, 10);
+    const array<string, 4> status_names = {"ACTUAL"s, "IRRELEVANT"s, "BANNED"s, "REMOVED"s};
+
+    SearchServer expected("and"s);
+    string input;
+    for (size_t i = 0; i < texts.size(); ++i) {
+        const auto status = static_cast<DocumentStatus>(i % 4);
+        const vector<int> ratings = i % 5 == 0 ? vector<int>{} : vector<int>{static_cast<int>(i % 9) - 4, 3};
+        expected.AddDocument(static_cast<int>(i) * 3, texts[i], status, ratings);
+        input += to_string(i * 3) + "\t"s + status_names[i % 4] + "\t"s;
+        for (const int rating : ratings) {
+            input += to_string(rating) + " "s;
+        }
+        input += "\t"s + texts[i] + (i % 7 == 0 ? "\r\n"s : "\n"s);
+        if (i % 100 == 0) {
+            input += "\n"s;
+        }
+    }
+    input.pop_back();
+
+    const auto query = dictionary[1] + " "s + dictionary[2] + " -"s + dictionary[3];
+    for (const size_t chunk_size : {1u, 100u, 4'096u, 1'000'000u}) {
+        SearchServer loaded("and"s);
+        istringstream stream(input);
+        ASSERT_EQUAL(LoadDocuments(stream, loaded, {chunk_size, 2}), texts.size());
+        ASSERT(vector<int>(loaded.begin(), loaded.end()) == vector<int>(expected.begin(), expected.end()));
+        for (const int id : expected) {
+            ASSERT(loaded.GetWordFrequencies(id) == expected.GetWordFrequencies(id));
+            ASSERT(loaded.MatchDocument(query, id) == expected.MatchDocument(query, id));
+        }
+        for (const DocumentStatus status : {DocumentStatus::ACTUAL, DocumentStatus::BANNED}) {
+            const auto expected_documents = expected.FindTopDocuments(query, status);
+            const auto actual = loaded.FindTopDocuments(query, status);
+            AssertSameDocuments(expected_documents, actual);
+        }
+    }
+
+    for (const string & bad_line : {"7\tACTUAL\t1\n"s, "x\tACTUAL\t1\tcat\n"s, "7\tNEW\t1\tcat\n"s, "7\tACTUAL\t1x\tcat\n"s}) {
+        SearchServer loaded;
+        istringstream stream("1\tACTUAL\t\tcat\n2\tBANNED\t5\tdog\n"s + bad_line + "8\tACTUAL\t\tfox\n"s);
+        bool caught = false;
+        try {
+            LoadDocuments(stream, loaded, {8, 1});
+        } catch (const invalid_argument& e) {
+            caught = string(e.what()).find("line 3"s) != string::npos;
+        }
+        ASSERT(caught);
+        ASSERT(vector<int>(loaded.begin(), loaded.end()) == vector<int>({1, 2}));
+    }
+
+    // ошибка добавления останавливает чтение
+    SearchServer loaded;
+    istringstream stream("1\tACTUAL\t\tcat\n1\tACTUAL\t\tdog\n2\tACTUAL\t\tfox\n"s);
+    bool caught = false;
+    try {
+        LoadDocuments(stream, loaded, {8, 1});
+    } catch (const invalid_argument&) {
+        caught = true;
+    }
+    ASSERT(caught);
+    ASSERT_EQUAL(loaded.GetDocumentCount(), 1);
+}
+
+// Прямой индекс отдаёт слова документа по возрастанию TermId с теми же TF,
+// что и карта GetWordFrequencies, и переживает удаление большинства документов.
+
+void TestDocumentTerms() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 200, 6);
+    const auto texts = GenerateQueries(generator, dictionary, 2'000, 12);
+    SearchServer server(dictionary[0]);
+    vector<NewDocument> documents;
+    for (size_t i = 0; i < texts.size(); ++i) {
+        if (i < texts.size() / 2) {
+            server.AddDocument(static_cast<int>(i), texts[i], DocumentStatus::ACTUAL, {1});
+        } else {
+            documents.push_back({static_cast<int>(i), texts[i], DocumentStatus::ACTUAL, {1}});
+        }
+    }
+    server.AddDocuments(documents);
+    map<int, map<string_view, double>> expected;
+    for (const int id : server) {
+        expected[id] = server.GetWordFrequencies(id);
+    }
+
+    auto check = [&server, &expected]() {
+        for (const int id : server) {
+            const vector<DocumentTerm> terms = server.GetDocumentTerms(id);
+            ASSERT_EQUAL(terms.size(), expected.at(id).size());
+            for (size_t i = 1; i < terms.size(); ++i) {
+                ASSERT(terms[i - 1].term_id < terms[i].term_id);
+            }
+            ASSERT(server.GetWordFrequencies(id) == expected.at(id));
+        }
+    };
+    check();
+
+    // после удаления трёх четвертей документов массив слов переписывается
+    vector<int> removed;
+    for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+        if (id % 4 != 0) {
+            removed.push_back(id);
+        }
+    }
+    server.RemoveDocuments(removed);
+    for (int id = 0; id < static_cast<int>(texts.size()); id += 8) {
+        server.RemoveDocument(id);
+    }
+    ASSERT(server.GetDocumentTerms(1).empty());
+    ASSERT(server.GetWordFrequencies(1).empty());
+    check();
+
+    const string query = dictionary[1] + " "s + dictionary[2];
+    for (const int id : server) {
+        const auto [words, status] = server.MatchDocument(query, id);
+        for (const string_view word : words) {
+            ASSERT(expected.at(id).count(word) > 0);
+        }
+    }
+}
+
+// Точный поиск дубликатов совпадает с перебором по множествам слов; поиск
+// похожих находит почти все пары с высоким сходством и не находит лишних.
+
+void TestFindDuplicates() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 2'000, 8);
+    SearchServer server;
+    vector<vector<string>> originals;
+    for (int id = 0; id < 1'500; ++id) {
+        vector<string> words;
+        if (id >= 500 && generator() % 2 == 0) {
+            // копия с переставленными и повторёнными словами или с одним заменённым словом
+            words = originals[generator() % originals.size()];
+            if (generator() % 2 == 0) {
+                reverse(words.begin(), words.end());
+                words.push_back(words.front());
+            } else {
+                words[generator() % words.size()] = dictionary[generator() % dictionary.size()];
+            }
+        } else {
+            for (int i = 0; i < 40; ++i) {
+                words.push_back(dictionary[generator() % dictionary.size()]);
+            }
+        }
+        originals.push_back(words);
+        string text;
+        for (const string & word : words) {
+            text += word + " "s;
+        }
+        server.AddDocument(id, text, DocumentStatus::ACTUAL, {1});
+    }
+
+    auto get_word_set = [&server](int id) {
+        set<string_view> words;
+        for (const auto & [word, _] : server.GetWordFrequencies(id)) {
+            words.insert(word);
+        }
+        return words;
+    };
+    vector<int> expected_exact;
+    map<set<string_view>, int> first_with_words;
+    for (const int id : server) {
+        if (!first_with_words.emplace(get_word_set(id), id).second) {
+            expected_exact.push_back(id);
+        }
+    }
+    ASSERT(!expected_exact.empty());
+    ASSERT(FindDuplicates(server) == expected_exact);
+
+    DuplicateSearchOptions options;
+    options.mode = DuplicateSearchOptions::Mode::NEAR;
+    options.jaccard_threshold = 0.85;
+    const vector<int> near = FindDuplicates(server, options);
+    ASSERT(includes(near.begin(), near.end(), expected_exact.begin(), expected_exact.end()));
+    auto jaccard = [](const set<string_view>& lhs, const set<string_view>& rhs) {
+        vector<string_view> common;
+        set_intersection(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), back_inserter(common));
+        return static_cast<double>(common.size()) / static_cast<double>(lhs.size() + rhs.size() - common.size());
+    };
+    // каждый найденный документ похож на какой-то оставленный документ с меньшим id
+    map<int, set<string_view>> word_sets;
+    for (const int id : server) {
+        word_sets[id] = get_word_set(id);
+    }
+    set<int> removed(near.begin(), near.end());
+    for (const int id : near) {
+        bool has_original = false;
+        for (auto it = word_sets.begin(); it->first < id && !has_original; ++it) {
+            has_original = removed.count(it->first) == 0 && jaccard(it->second, word_sets[id]) >= 0.85;
+        }
+        ASSERT(has_original);
+    }
+    // копии с одним заменённым словом из 40 похожи на оригинал не меньше чем на 0.9
+    ASSERT(near.size() > expected_exact.size() + (1'500 - 500) / 4 * 9 / 10 - 20);
+
+    ASSERT(RemoveDuplicates(server, options) == near);
+    ASSERT_EQUAL(server.GetDocumentCount(), 1'500 - static_cast<int>(near.size()));
+    ASSERT(FindDuplicates(server, options).empty());
+}
+
+// Слова и признак управляющих символов совпадают с побайтным разбором
+// на строках разной длины, в том числе с границами слов на стыках блоков
+void TestWordTokenizer() {
+    auto split = [](string_view text) {
+        vector<pair<string_view, bool>> words;
+        for (size_t position = 0; position < text.size();) {
+            if (text[position] == ' ') {
+                ++position;
+                continue;
+            }
+            const size_t end = min(text.find(' ', position), text.size());
+            const string_view word = text.substr(position, end - position);
+            words.emplace_back(word, any_of(word.begin(), word.end(), [](char ch) {
+                return static_cast<unsigned char>(ch) < 32;
+            }));
+            position = end;
+        }
+        return words;
+    };
+    auto tokenize = [](string_view text) {
+        vector<pair<string_view, bool>> words;
+        for (const TextWord & word : WordTokenizer(text)) {
+            words.emplace_back(word.text, word.has_special_symbols);
+        }
+        return words;
+    };
+
+    ASSERT(tokenize(""sv).empty());
+    ASSERT(tokenize("     "sv).empty());
+    ASSERT(SplitIntoWords("  white cat  and   fancy collar "sv) == vector<string_view>({"white"sv, "cat"sv, "and"sv, "fancy"sv, "collar"sv}));
+    ASSERT(tokenize("cat\x01 dog\x1F \x7F\xFF"sv) == (vector<pair<string_view, bool>>{{"cat\x01"sv, true}, {"dog\x1F"sv, true}, {"\x7F\xFF"sv, false}}));
+
+    // символы с кодами вокруг границы пробела и за пределами ASCII
+    const string alphabet = "  \x01\x1F!aZ~\x7F\x80\xFF"s;
+    mt19937 generator;
+    for (int i = 0; i < 5'000; ++i) {
+        string text(uniform_int_distribution<size_t>(0, 70)(generator), ' ');
+        for (char & ch : text) {
+            ch = alphabet[uniform_int_distribution<size_t>(0, alphabet.size() - 1)(generator)];
+        }
+        // подстрока со смещённым началом проверяет невыровненные загрузки
+        const string_view view = string_view(text).substr(min<size_t>(text.size(), i % 3));
+        ASSERT(tokenize(view) == split(view));
+    }
+}
+
+// Список id слов запроса переходит из встроенного буфера в кучу и обратно,
+// а длинные запросы с повторами дают те же слова, что и короткие
+void TestQueryPlan() {
+    mt19937 generator;
+    TermIdList term_ids;
+    for (int round = 0; round < 50; ++round) {
+        term_ids.clear();
+        set<TermId> expected;
+        const int count = uniform_int_distribution<int>(0, 60)(generator);
+        for (int i = 0; i < count; ++i) {
+            const TermId term_id = uniform_int_distribution<TermId>(0, 30)(generator);
+            term_ids.push_back(term_id);
+            expected.insert(term_id);
+        }
+        ASSERT_EQUAL(term_ids.size(), static_cast<size_t>(count));
+        term_ids.SortUnique();
+        ASSERT(vector<TermId>(term_ids.begin(), term_ids.end()) == vector<TermId>(expected.begin(), expected.end()));
+        term_ids.push_back(100);
+        ASSERT_EQUAL(term_ids[term_ids.size() - 1], 100u);
+    }
+
+    SearchServer server("and with"s);
+    string text;
+    for (int i = 0; i < 40; ++i) {
+        text += "word"s + to_string(i) + " "s;
+    }
+    server.AddDocument(1, text, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "word0 word39 and cat"s, DocumentStatus::ACTUAL, {2});
+    // 40 разных плюс-слов дважды, стоп-слова и неизвестные слова
+    const string query = text + text + "and with unknown"s;
+    const auto [words, status] = server.MatchDocument(query, 1);
+    ASSERT_EQUAL(words.size(), 40u);
+    ASSERT(is_sorted(words.begin(), words.end()));
+    ASSERT_EQUAL(server.FindTopDocuments(query).size(), 2u);
+    ASSERT(get<0>(server.MatchDocument(query + " -cat"s, 2)).empty());
+    ASSERT_EQUAL(server.FindTopDocuments(query + " -cat"s).size(), 1u);
+}
+
+// Кэш планов отдаёт сохранённый план только в том же поколении индекса:
+// новые слова и стоп-слова меняют результат и при включённом кэше
+void TestQueryPlanCache() {
+    SearchServer server("and"s);
+    server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "black dog"s, DocumentStatus::ACTUAL, {2});
+    server.FindTopDocuments("cat"s);
+    ASSERT_EQUAL(server.GetQueryPlanCacheStats().misses, 0u);
+
+    server.SetQueryPlanCacheCapacity(16);
+    auto find_ids = [&server](const string& query) {
+        vector<int> ids;
+        for (const Document & document : server.FindTopDocuments(query)) {
+            ids.push_back(document.id);
+        }
+        sort(ids.begin(), ids.end());
+        return ids;
+    };
+    ASSERT(find_ids("cat parrot -dog"s) == vector<int>{1});
+    ASSERT(find_ids("cat parrot -dog"s) == vector<int>{1});
+    ASSERT_EQUAL(server.GetQueryPlanCacheStats().hits, 1u);
+    ASSERT_EQUAL(server.GetQueryPlanCacheStats().misses, 1u);
+    ASSERT(get<0>(server.MatchDocument("cat parrot -dog"s, 1)) == vector<string_view>{"cat"sv});
+    ASSERT_EQUAL(server.GetQueryPlanCacheStats().hits, 2u);
+
+    // слово, которого не было в индексе, делает план устаревшим
+    server.AddDocument(3, "grey parrot"s, DocumentStatus::ACTUAL, {3});
+    ASSERT(find_ids("cat parrot -dog"s) == vector<int>({1, 3}));
+    ASSERT_EQUAL(server.GetQueryPlanCacheStats().misses, 2u);
+    // известные слова поколение не меняют, а удаление оставляет план верным
+    server.AddDocument(4, "black cat and dog"s, DocumentStatus::ACTUAL, {4});
+    server.RemoveDocument(3);
+    ASSERT(find_ids("cat parrot -dog"s) == vector<int>{1});
+    ASSERT_EQUAL(server.GetQueryPlanCacheStats().hits, 3u);
+    server.SetStopWords("cat"s);
+    ASSERT(find_ids("cat parrot -dog"s).empty());
+
+    // ошибочные запросы не кэшируются и бросают исключение каждый раз
+    for (int i = 0; i < 2; ++i) {
+        try {
+            server.FindTopDocuments("cat --dog"s);
+            ASSERT(false);
+        } catch (const invalid_argument&) {
+        }
+        try {
+            server.MatchDocument("cat --dog"s, 100);
+            ASSERT(false);
+        } catch (const out_of_range&) {
+        }
+    }
+
+    // из заполненного кэша вытесняются давно использованные планы
+    server.SetQueryPlanCacheCapacity(QueryPlanCache::SHARD_COUNT);
+    const auto stats = server.GetQueryPlanCacheStats();
+    for (int i = 0; i < 100; ++i) {
+        server.FindTopDocuments("dog word"s + to_string(i));
+    }
+    for (int i = 0; i < 100; ++i) {
+        server.FindTopDocuments("dog word"s + to_string(i));
+    }
+    const auto after = server.GetQueryPlanCacheStats();
+    ASSERT(after.hits - stats.hits < 100);
+    ASSERT_EQUAL(after.hits + after.misses - stats.hits - stats.misses, 200u);
+
+    server.SetQueryPlanCacheCapacity(0);
+    server.FindTopDocuments("dog"s);
+    ASSERT_EQUAL(server.GetQueryPlanCacheStats().misses, after.misses);
+}
+
+// Кэш результатов не отдаёт результат, посчитанный до изменения документов,
+// и различает статус, max_count и политику поиска
+void TestResultCache() {
+    SearchServer server("and"s);
+    server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "black cat"s, DocumentStatus::BANNED, {2});
+    server.FindTopDocuments("cat"s);
+    ASSERT_EQUAL(server.GetResultCacheStats().misses, 0u);
+
+    server.SetResultCacheBudget(1 << 20);
+    auto find_ids = [&server](const string& query, DocumentStatus status = DocumentStatus::ACTUAL, size_t max_count = 5) {
+        vector<int> ids;
+        for (const Document & document : server.FindTopDocuments(query, status, max_count)) {
+            ids.push_back(document.id);
+        }
+        sort(ids.begin(), ids.end());
+        return ids;
+    };
+    const vector<Document> expected = server.FindTopDocuments("cat -dog"s);
+    const vector<Document> cached = server.FindTopDocuments("cat -dog"s);
+    AssertSameDocuments(expected, cached);
+    ASSERT_EQUAL(server.GetResultCacheStats().hits, 1u);
+    ASSERT(find_ids("cat -dog"s, DocumentStatus::BANNED) == vector<int>{2});
+    ASSERT(find_ids("cat -dog"s, DocumentStatus::ACTUAL, 0).empty());
+    server.FindTopDocuments(execution::par, "cat -dog"s);
+    server.FindTopDocuments(search_engine::wand, "cat -dog"s);
+    ASSERT_EQUAL(server.GetResultCacheStats().hits, 1u);
+    ASSERT_EQUAL(server.GetResultCacheStats().misses, 5u);
+    // поиск с предикатом мимо кэша
+    server.FindTopDocuments("cat -dog"s, [](int, DocumentStatus, int) {
+        return true;
+    });
+    ASSERT_EQUAL(server.GetResultCacheStats().misses, 5u);
+
+    // добавление документа с известными словами меняет результат
+    server.AddDocument(3, "cat and cat"s, DocumentStatus::ACTUAL, {3});
+    ASSERT(find_ids("cat -dog"s) == vector<int>({1, 3}));
+    server.AddDocument(4, "grey dog"s, DocumentStatus::ACTUAL, {4});
+    server.RemoveDocument(3);
+    ASSERT(find_ids("cat -dog"s) == vector<int>{1});
+    server.AddDocuments({{5, "old cat"sv, DocumentStatus::ACTUAL, {5}}});
+    ASSERT(find_ids("cat -dog"s) == vector<int>({1, 5}));
+    server.SetStopWords("old"s);
+    ASSERT(find_ids("old"s).empty());
+    ASSERT_EQUAL(server.GetResultCacheStats().hits, 1u);
+    ASSERT(find_ids("old"s).empty());
+    ASSERT_EQUAL(server.GetResultCacheStats().hits, 2u);
+
+    // бюджет на несколько записей: большинство из 100 запросов вытесняется
+    server.SetResultCacheBudget(ResultCache::SHARD_COUNT * 300);
+    const auto stats = server.GetResultCacheStats();
+    for (int round = 0; round < 2; ++round) {
+        for (int i = 0; i < 100; ++i) {
+            server.FindTopDocuments("cat word"s + to_string(i));
+        }
+    }
+    const auto after = server.GetResultCacheStats();
+    ASSERT(after.hits - stats.hits < 50);
+    ASSERT_EQUAL(after.hits + after.misses - stats.hits - stats.misses, 200u);
+}
+
+// Пакетный поиск возвращает в точности те же документы, что и поиск по
+// одному запросу, в том числе при делении номеров документов на окна
+void TestFindTopDocumentsBatch() {
+    SetThreadPoolSize(3);
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 200, 6);
+    const auto documents = GenerateQueries(generator, dictionary, 3'000, 30);
+
+    SearchServer search_server(dictionary[0]);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const auto status = static_cast<DocumentStatus>(uniform_int_distribution(0, 2)(generator));
+        search_server.AddDocument(i, documents[i], status, {uniform_int_distribution(-5, 5)(generator)});
+    }
+    for (int i = 0; i < 3'000; i += 9) {
+        search_server.RemoveDocument(i);
+    }
+    vector<string> queries;
+    for (int i = 0; i < 200; ++i) {
+        queries.push_back(GenerateQuery(generator, dictionary, uniform_int_distribution(1, 8)(generator), 0.1));
+    }
+    // повторы и запрос без слов из индекса
+    queries.push_back(queries[0]);
+    queries.push_back("unknown"s);
+
+    for (const DocumentStatus status : {DocumentStatus::ACTUAL, DocumentStatus::BANNED}) {
+        const auto results = search_server.FindTopDocumentsBatch(queries, status, 10);
+        ASSERT_EQUAL(results.size(), queries.size());
+        for (size_t i = 0; i < queries.size(); ++i) {
+            AssertSameDocuments(search_server.FindTopDocuments(queries[i], status, 10), results[i]);
+        }
+    }
+    const auto processed = ProcessQueries(search_server, queries);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        AssertSameDocuments(search_server.FindTopDocuments(queries[i]), processed[i]);
+    }
+    // с кэшем результатов часть запросов берётся из него
+    search_server.SetResultCacheBudget(1 << 20);
+    search_server.FindTopDocuments(queries[1]);
+    const auto stats = search_server.GetResultCacheStats();
+    const auto cached = search_server.FindTopDocumentsBatch(queries);
+    ASSERT(search_server.GetResultCacheStats().hits > stats.hits);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        AssertSameDocuments(processed[i], cached[i]);
+    }
+    try {
+        search_server.FindTopDocumentsBatch({"cat"s, "cat --dog"s});
+        ASSERT(false);
+    } catch (const invalid_argument&) {
+    }
+
+    // индекс напрямую: окна по 500 вхождений
+    SearchIndex index(dictionary[0]);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        index.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {static_cast<int>(i % 7)});
+    }
+    for (int i = 0; i < 3'000; i += 5) {
+        index.RemoveDocument(i);
+    }
+    vector<QueryPlan> plans(queries.size());
+    for (size_t i = 0; i < queries.size(); ++i) {
+        index.ParseQuery(queries[i], plans[i]);
+    }
+    const auto windowed = index.FindTopDocumentsBatch(plans, DocumentStatus::ACTUAL, 5, 500);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        AssertSameDocuments(index.FindTopDocuments(execution::seq, plans[i], DocumentStatus::ACTUAL, 5), windowed[i]);
+    }
+    SetThreadPoolSize(max(1u, thread::hardware_concurrency()) - 1);
+}
+
+// Поиск одновременно с добавлением и удалением документов: читатели всегда
+// видят согласованный индекс, ошибка изменения не разводит копии индекса.
+
+void TestConcurrentReadsAndWrites() {
+    SearchServer server("and"s);
+    for (int i = 0; i < 10; ++i) {
+        server.AddDocument(i, "cat and cat"s, DocumentStatus::ACTUAL, {i});
+    }
+    server.AddDocument(100, "mouse"s, DocumentStatus::ACTUAL, {1});
+
+    atomic<bool> writing = true;
+    atomic<int> failures = 0;
+    auto reader = [&server, &writing, &failures]() {
+        do {
+            const auto cats = server.FindTopDocuments("cat"s);
+            const bool cats_ok = cats.size() == 5 && cats[0].id == 9 && cats[4].id == 5;
+            const auto dogs = server.FindTopDocuments(execution::par, "dog"s, DocumentStatus::ACTUAL, 20);
+            const bool dogs_ok = all_of(dogs.begin(), dogs.end(), [](const Document& document) {
+                return document.id >= 1'000 && document.id < 2'000;
+            });
+            if (!cats_ok || !dogs_ok) {
+                ++failures;
+            }
+        } while (writing);
+    };
+    vector<thread> readers;
+    for (int i = 0; i < 3; ++i) {
+        readers.emplace_back(reader);
+    }
+    for (int i = 1'000; i < 1'300; ++i) {
+        server.AddDocument(i, "dog number "s + to_string(i % 37), DocumentStatus::ACTUAL, {1});
+        if (i % 3 == 0) {
+            server.RemoveDocument(i - 1);
+        }
+    }
+    writing = false;
+    for (thread & t : readers) {
+        t.join();
+    }
+    ASSERT_EQUAL(failures.load(), 0);
+    ASSERT_EQUAL(server.GetDocumentCount(), 11 + 300 - 100);
+
+    try {
+        server.AddDocument(1'000, "dog"s, DocumentStatus::ACTUAL, {1});
+    } catch (const invalid_argument&) {
+    }
+    for (int i = 0; i < 2; ++i) {
+        // обе копии индекса по очереди становятся опубликованной
+        server.AddDocument(3'000 + i, "parrot"s, DocumentStatus::ACTUAL, {1});
+        ASSERT_EQUAL(server.GetDocumentCount(), 11 + 300 - 100 + i + 1);
+        ASSERT_EQUAL(server.FindTopDocuments("parrot"s).size(), static_cast<size_t>(i + 1));
+    }
+}
+
+// Пул потоков: вложенные параллельные циклы не блокируют друг друга,
+// исключение из задачи пробрасывается ожидающему потоку.
+
+void TestThreadPool() {
+    ThreadPool pool(3);
+    vector<vector<int>> results(20);
+    pool.ParallelFor(results.size(), [&pool, &results](size_t i) {
+        results[i].resize(100);
+        pool.ParallelFor(100, [&results, i](size_t j) {
+            results[i][j] = static_cast<int>(i * j);
+        });
+    });
+    for (size_t i = 0; i < results.size(); ++i) {
+        ASSERT_EQUAL(accumulate(results[i].begin(), results[i].end(), 0), static_cast<int>(i * 4950));
+    }
+
+    bool caught = false;
+    try {
+        pool.ParallelFor(10, [](size_t i) {
+            if (i == 7) {
+                throw invalid_argument("task failed"s);
+            }
+        });
+    } catch (const invalid_argument&) {
+        caught = true;
+    }
+    ASSERT(caught);
+
+    ThreadPool inline_pool(0);
+    int sum = 0;
+    inline_pool.ParallelFor(10, [&sum](size_t i) {
+        sum += static_cast<int>(i);
+    });
+    ASSERT_EQUAL(sum, 45);
+}
+
 template <typename ExecutionPolicy>
 void Test(string_view mark, const SearchServer& search_server, const vector<string>& queries, ExecutionPolicy&& policy) {
     LOG_DURATION(mark);
@@ -872,11 +2355,68 @@ void Benchmark_FindTopDocuments_seq_par() {
 
     TEST(seq);
     TEST(par);
+    Test("wand"sv, search_server, queries, search_engine::wand);
 } 
 
+// Частоты слов по закону Ципфа и короткие запросы: на таких данных WAND
+// отсекает большинство документов с частыми словами
+void Benchmark_FindTopDocuments_wand() {
+    mt19937 generator;
+
+    const auto dictionary = GenerateDictionary(generator, 20'000, 10);
+    vector<double> word_weights;
+    word_weights.reserve(dictionary.size());
+    for (size_t i = 0; i < dictionary.size(); ++i) {
+        word_weights.push_back(1.0 / (i + 1));
+    }
+    discrete_distribution<size_t> word_distribution(word_weights.begin(), word_weights.end());
+    auto generate_text = [&](int word_count) {
+        string text;
+        for (int i = 0; i < word_count; ++i) {
+            if (!text.empty()) {
+                text.push_back(' ');
+            }
+            text += dictionary[word_distribution(generator)];
+        }
+        return text;
+    };
+
+    SearchServer search_server;
+    for (int i = 0; i < 30'000; ++i) {
+        search_server.AddDocument(i, generate_text(uniform_int_distribution(10, 60)(generator)), DocumentStatus::ACTUAL, {1, 2, 3});
+    }
+
+    vector<string> queries;
+    for (int i = 0; i < 500; ++i) {
+        queries.push_back(generate_text(uniform_int_distribution(1, 3)(generator)));
+    }
+
+    TEST(seq);
+    Test("wand"sv, search_server, queries, search_engine::wand);
+}
+
 void AllTests() {
     {
         TestSearchServer();
+        RUN_TEST(TestThreadPool);
+        RUN_TEST(TestDocumentBitmap);
+        RUN_TEST(TestSearchEnginesMatchSequential);
+        RUN_TEST(TestConcurrentReadsAndWrites);
+        RUN_TEST(TestIndexSegments);
+        RUN_TEST(TestTombstoneCompaction);
+        RUN_TEST(TestDeadTermErasure);
+        RUN_TEST(TestAddDocumentsMatchSequential);
+        RUN_TEST(TestRemoveDocumentsMatchSequential);
+        RUN_TEST(TestSnapshot);
+        RUN_TEST(TestWriteAheadLog);
+        RUN_TEST(TestLoadDocuments);
+        RUN_TEST(TestDocumentTerms);
+        RUN_TEST(TestFindDuplicates);
+        RUN_TEST(TestWordTokenizer);
+        RUN_TEST(TestQueryPlan);
+        RUN_TEST(TestQueryPlanCache);
+        RUN_TEST(TestResultCache);
+        RUN_TEST(TestFindTopDocumentsBatch);
     }
 
     cout << "//////////////////////////////////////////////////////////////" << endl;
@@ -977,7 +2517,9 @@ void AllTests() {
     AddDocument(search_server, 9, "nasty rat with curly hair"s, DocumentStatus::ACTUAL, {1, 2});
     
     cout << "Before duplicates removed: "s << search_server.GetDocumentCount() << endl;
-    RemoveDuplicates(search_server);
+    for (const int document_id : RemoveDuplicates(search_server)) {
+        cout << "Found duplicate document id "s << document_id << '\n';
+    }
     cout << "After duplicates removed: "s << search_server.GetDocumentCount() << endl;
     }
 
@@ -1004,4 +2546,8 @@ void AllTests() {
     cout << "//////////////////////////////////////////////////////////////" << endl;
 
     Benchmark_FindTopDocuments_seq_par();
+
+    cout << "//////////////////////////////////////////////////////////////" << endl;
+
+    Benchmark_FindTopDocuments_wand();
 }
@@ -0,0 +1,164 @@
+#include "thread_pool.h"
+
+#include <utility>
+
+using namespace std;
+
+namespace {
+
+// пул и номер очереди, к которым относится текущий рабочий поток
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_queue = 0;
+
+}
+
+ThreadPool::ThreadPool(size_t thread_count) {
+    for (size_t i = 0; i <= thread_count; ++i) {
+        queues_.push_back(make_unique<TaskQueue>());
+    }
+    threads_.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        threads_.emplace_back([this, i] {
+            WorkerLoop(i);
+        });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard guard(sleep_mutex_);
+        stopping_ = true;
+    }
+    wake_up_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+void ThreadPool::Push(Task task) {
+    const size_t queue_index = current_pool == this ? current_queue : queues_.size() - 1;
+    // счётчик увеличивается раньше, чем задачу можно забрать, и не уходит в минус
+    queued_task_count_.fetch_add(1);
+    {
+        TaskQueue& queue = *queues_[queue_index];
+        lock_guard guard(queue.mutex);
+        queue.tasks.push_back(move(task));
+    }
+    // задачу выполнит один поток, остальных будить незачем
+    NotifyOne();
+}
+
+bool ThreadPool::TryRunOne() {
+    const size_t own_index = current_pool == this ? current_queue : queues_.size() - 1;
+    Task task;
+    {
+        // свои задачи берём с конца: они свежие и их данные ещё в кэше
+        TaskQueue& queue = *queues_[own_index];
+        lock_guard guard(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+    }
+    for (size_t shift = 1; !task && shift < queues_.size(); ++shift) {
+        TaskQueue& queue = *queues_[(own_index + shift) % queues_.size()];
+        lock_guard guard(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+    }
+    if (!task) {
+        return false;
+    }
+    queued_task_count_.fetch_sub(1);
+    task();
+    return true;
+}
+
+void ThreadPool::Finish(atomic<size_t>& pending) {
+    if (pending.fetch_sub(1) == 1) {
+        // группу могут ждать несколько потоков
+        NotifyAll();
+    }
+}
+
+void ThreadPool::WaitUntilDone(const atomic<size_t>& pending) {
+    while (pending.load() > 0) {
+        if (TryRunOne()) {
+            continue;
+        }
+        unique_lock lock(sleep_mutex_);
+        wake_up_.wait(lock, [this, &pending] {
+            return pending.load() == 0 || queued_task_count_.load() > 0;
+        });
+    }
+}
+
+void ThreadPool::WorkerLoop(size_t index) {
+    current_pool = this;
+    current_queue = index;
+    for (;;) {
+        if (TryRunOne()) {
+            continue;
+        }
+        unique_lock lock(sleep_mutex_);
+        wake_up_.wait(lock, [this] {
+            return stopping_.load() || queued_task_count_.load() > 0;
+        });
+        if (stopping_.load() && queued_task_count_.load() == 0) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::NotifyOne() {
+    // захват мьютекса не даёт уведомлению проскочить между проверкой
+    // условия и засыпанием ждущего потока
+    {
+        lock_guard guard(sleep_mutex_);
+    }
+    wake_up_.notify_one();
+}
+
+void ThreadPool::NotifyAll() {
+    {
+        lock_guard guard(sleep_mutex_);
+    }
+    wake_up_.notify_all();
+}
+
+namespace {
+
+// пул создаётся и пересоздаётся под мьютексом, а читается через атомарный
+// указатель, чтобы параллельные вызовы не захватывали мьютекс
+mutex global_pool_mutex;
+unique_ptr<ThreadPool> global_pool;
+atomic<ThreadPool*> global_pool_pointer = nullptr;
+
+size_t GetDefaultThreadCount() {
+    const size_t hardware_threads = thread::hardware_concurrency();
+    return hardware_threads > 1 ? hardware_threads - 1 : 0;
+}
+
+}
+
+ThreadPool& GetThreadPool() {
+    if (ThreadPool* pool = global_pool_pointer.load(memory_order_acquire)) {
+        return *pool;
+    }
+    lock_guard guard(global_pool_mutex);
+    if (!global_pool) {
+        global_pool = make_unique<ThreadPool>(GetDefaultThreadCount());
+        global_pool_pointer.store(global_pool.get(), memory_order_release);
+    }
+    return *global_pool;
+}
+
+void SetThreadPoolSize(size_t thread_count) {
+    lock_guard guard(global_pool_mutex);
+    global_pool_pointer.store(nullptr, memory_order_release);
+    global_pool.reset();
+    global_pool = make_unique<ThreadPool>(thread_count);
+    global_pool_pointer.store(global_pool.get(), memory_order_release);
+}
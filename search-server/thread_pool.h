@@ -0,0 +1,136 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Пул потоков с перехватом задач (work stealing). Каждый рабочий поток берёт
+// задачи из своей очереди с конца, а при её опустошении забирает их с начала
+// очередей соседей. Поток, ожидающий группу задач, сам выполняет задачи пула,
+// поэтому вложенный параллелизм (параллельный запрос внутри параллельной
+// обработки запросов) не блокирует потоки и не создаёт новых.
+class ThreadPool {
+public:
+    // thread_count == 0: все задачи выполняет ожидающий их поток
+    explicit ThreadPool(size_t thread_count);
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool();
+
+    size_t GetThreadCount() const {
+        return threads_.size();
+    }
+
+    // Сколько задач имеет смысл запускать одновременно: рабочие потоки
+    // плюс ожидающий поток
+    size_t GetConcurrency() const {
+        return threads_.size() + 1;
+    }
+
+    class TaskGroup {
+    public:
+        explicit TaskGroup(ThreadPool& pool)
+            : pool_(pool)
+        {}
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator=(const TaskGroup&) = delete;
+
+        ~TaskGroup() {
+            pool_.WaitUntilDone(pending_);
+        }
+
+        template <typename Function>
+        void Run(Function function) {
+            pending_.fetch_add(1);
+            pool_.Push([this, function = std::move(function)]() mutable {
+                try {
+                    function();
+                } catch (...) {
+                    std::lock_guard guard(exception_mutex_);
+                    if (!exception_) {
+                        exception_ = std::current_exception();
+                    }
+                }
+                pool_.Finish(pending_);
+            });
+        }
+
+        // Ждёт завершения всех задач группы, выполняя тем временем задачи пула.
+        // Пробрасывает первое исключение, выброшенное задачей.
+        void Wait() {
+            pool_.WaitUntilDone(pending_);
+            if (exception_) {
+                std::rethrow_exception(std::exchange(exception_, nullptr));
+            }
+        }
+
+    private:
+        ThreadPool& pool_;
+        std::atomic<size_t> pending_ = 0;
+        std::mutex exception_mutex_;
+        std::exception_ptr exception_;
+    };
+
+    // Вызывает function(i) для i из [0, count), разбивая диапазон на части
+    template <typename Function>
+    void ParallelFor(size_t count, Function function) {
+        const size_t chunk_count = std::min(count, GetConcurrency() * 4);
+        if (chunk_count <= 1) {
+            for (size_t i = 0; i < count; ++i) {
+                function(i);
+            }
+            return;
+        }
+        TaskGroup group(*this);
+        for (size_t chunk = 0; chunk < chunk_count; ++chunk) {
+            const size_t first = count * chunk / chunk_count;
+            const size_t last = count * (chunk + 1) / chunk_count;
+            group.Run([&function, first, last] {
+                for (size_t i = first; i < last; ++i) {
+                    function(i);
+                }
+            });
+        }
+        group.Wait();
+    }
+
+private:
+    using Task = std::function<void()>;
+
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    // очереди рабочих потоков и последняя, общая, для задач извне пула
+    std::vector<std::unique_ptr<TaskQueue>> queues_;
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> queued_task_count_ = 0;
+    std::atomic<bool> stopping_ = false;
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_up_;
+
+    void Push(Task task);
+    bool TryRunOne();
+    void Finish(std::atomic<size_t>& pending);
+    void WaitUntilDone(const std::atomic<size_t>& pending);
+    void WorkerLoop(size_t index);
+    void NotifyOne();
+    void NotifyAll();
+};
+
+// Общий для процесса пул; по умолчанию в нём hardware_concurrency() - 1
+// рабочих потоков, ещё одним служит поток, ожидающий задачи
+ThreadPool& GetThreadPool();
+
+// Пересоздаёт общий пул с заданным числом рабочих потоков. Нельзя вызывать,
+// пока пул выполняет задачи.
+void SetThreadPoolSize(size_t thread_count);
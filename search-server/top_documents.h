@@ -0,0 +1,68 @@
+#pragma once
+
+#include "document.h"
+
+#include <algorithm>
+#include <vector>
+
+// Отбирает не более max_count лучших документов. Кандидаты хранятся в куче
+// размера max_count с худшим из отобранных в вершине, поэтому все найденные
+// документы целиком никогда не сортируются.
+class TopDocumentsCollector {
+public:
+    explicit TopDocumentsCollector(size_t max_count)
+        : max_count_(max_count)
+    {}
+
+    // Порядок CompareByRelevance; равные по нему документы упорядочены по id,
+    // чтобы результат не зависел от порядка обхода.
+    static bool IsBetter(const Document& lhs, const Document& rhs) {
+        const CompareByRelevance compare;
+        if (compare(lhs, rhs)) {
+            return true;
+        }
+        if (compare(rhs, lhs)) {
+            return false;
+        }
+        return lhs.id < rhs.id;
+    }
+
+    // Возвращает true, если документ попал в число отобранных
+    bool Push(const Document& document) {
+        if (documents_.size() < max_count_) {
+            documents_.push_back(document);
+            std::push_heap(documents_.begin(), documents_.end(), IsBetter);
+            return true;
+        }
+        if (max_count_ == 0 || !IsBetter(document, documents_.front())) {
+            return false;
+        }
+        std::pop_heap(documents_.begin(), documents_.end(), IsBetter);
+        documents_.back() = document;
+        std::push_heap(documents_.begin(), documents_.end(), IsBetter);
+        return true;
+    }
+
+    size_t GetMaxCount() const {
+        return max_count_;
+    }
+
+    bool IsFull() const {
+        return documents_.size() >= max_count_;
+    }
+
+    // Худший из отобранных; определён только для непустого набора
+    const Document& GetWorst() const {
+        return documents_.front();
+    }
+
+    // Отобранные документы от лучшего к худшему
+    std::vector<Document> Extract() {
+        std::sort_heap(documents_.begin(), documents_.end(), IsBetter);
+        return std::move(documents_);
+    }
+
+private:
+    size_t max_count_;
+    std::vector<Document> documents_;
+};
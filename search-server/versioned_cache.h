@@ -0,0 +1,155 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+// Конкурентный кэш значений по ключу (текст, tag). Разделён на сегменты со
+// своими блокировками и LRU-списками; у каждой записи есть стоимость, и
+// сегмент вытесняет самые давно использованные записи, пока их суммарная
+// стоимость превышает его долю бюджета. Запись хранит поколение данных,
+// по которым вычислена, и находится только в том же поколении.
+// С нулевым бюджетом (по умолчанию) кэш выключен и ничего не хранит.
+template <typename Value>
+class VersionedCache {
+public:
+    static constexpr size_t SHARD_COUNT = 16;
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+
+    // Задаёт общий бюджет; уменьшение вытесняет лишнее, 0 очищает кэш
+    void SetBudget(size_t budget) {
+        budget_.store(budget);
+        for (size_t i = 0; i < SHARD_COUNT; ++i) {
+            Shard & shard = shards_[i];
+            std::lock_guard guard(shard.mutex);
+            // остаток делится между первыми сегментами
+            shard.budget = budget / SHARD_COUNT + (i < budget % SHARD_COUNT ? 1 : 0);
+            Shrink(shard);
+        }
+    }
+
+    size_t GetBudget() const {
+        return budget_.load();
+    }
+
+    // Копирует в value значение, вычисленное в поколении generation
+    bool Find(std::string_view text, uint64_t tag, uint64_t generation, Value& value) {
+        if (budget_.load() == 0) {
+            return false;
+        }
+        const KeyView key{text, tag};
+        Shard & shard = GetShard(key);
+        {
+            std::lock_guard guard(shard.mutex);
+            const auto position = shard.positions.find(key);
+            if (position != shard.positions.end() && position->second->generation == generation) {
+                shard.entries.splice(shard.entries.begin(), shard.entries, position->second);
+                value = position->second->value;
+                hits_.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Запоминает значение; значение более нового поколения не заменяется
+    // старым, а дороже доли бюджета сегмента - не запоминается
+    void Insert(std::string_view text, uint64_t tag, uint64_t generation, Value value, size_t cost) {
+        if (budget_.load() == 0) {
+            return;
+        }
+        const KeyView key{text, tag};
+        Shard & shard = GetShard(key);
+        std::lock_guard guard(shard.mutex);
+        if (cost > shard.budget) {
+            return;
+        }
+        const auto position = shard.positions.find(key);
+        if (position != shard.positions.end()) {
+            Entry & entry = *position->second;
+            // читатель копии данных, ещё не получившей изменение, не откатывает запись
+            if (entry.generation < generation) {
+                shard.cost += cost - entry.cost;
+                entry.generation = generation;
+                entry.value = std::move(value);
+                entry.cost = cost;
+            }
+            shard.entries.splice(shard.entries.begin(), shard.entries, position->second);
+        } else {
+            shard.entries.push_front({std::string{text}, tag, generation, std::move(value), cost});
+            shard.positions.emplace(KeyView{shard.entries.front().text, tag}, shard.entries.begin());
+            shard.cost += cost;
+        }
+        Shrink(shard);
+    }
+
+    // Обращения к включённому кэшу; устаревшая запись считается промахом
+    Stats GetStats() const {
+        return {hits_.load(), misses_.load()};
+    }
+
+private:
+    struct KeyView {
+        std::string_view text;
+        uint64_t tag;
+
+        bool operator==(const KeyView& other) const {
+            return tag == other.tag && text == other.text;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const KeyView& key) const {
+            return std::hash<std::string_view>{}(key.text) ^ (key.tag * 0x9E3779B97F4A7C15ull);
+        }
+    };
+
+    struct Entry {
+        std::string text;
+        uint64_t tag;
+        uint64_t generation;
+        Value value;
+        size_t cost;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        // в начале - последние использованные
+        std::list<Entry> entries;
+        // ключи указывают на тексты в entries
+        std::unordered_map<KeyView, typename std::list<Entry>::iterator, KeyHash> positions;
+        size_t cost = 0;
+        size_t budget = 0;
+    };
+
+    std::array<Shard, SHARD_COUNT> shards_;
+    std::atomic<size_t> budget_{0};
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+
+    Shard& GetShard(const KeyView& key) {
+        return shards_[KeyHash{}(key) % SHARD_COUNT];
+    }
+
+    static void Shrink(Shard& shard) {
+        while (shard.cost > shard.budget) {
+            const Entry & entry = shard.entries.back();
+            shard.cost -= entry.cost;
+            shard.positions.erase(KeyView{entry.text, entry.tag});
+            shard.entries.pop_back();
+        }
+    }
+};
@@ -0,0 +1,397 @@
+#include "write_ahead_log.h"
+#include "snapshot.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+constexpr size_t RECORD_HEADER_SIZE = 2 * sizeof(uint32_t);
+
+uint32_t RecordChecksum(const char* data, size_t size) {
+    SnapshotChecksum checksum;
+    checksum.Update(data, size);
+    return static_cast<uint32_t>(checksum.Finish());
+}
+
+template <typename T>
+void Put(vector<char>& buffer, const T& value) {
+    const auto* bytes = reinterpret_cast<const char*>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(value));
+}
+
+void PutText(vector<char>& buffer, string_view text) {
+    Put(buffer, static_cast<uint32_t>(text.size()));
+    buffer.insert(buffer.end(), text.begin(), text.end());
+}
+
+// Разбор данных записи с проверкой границ
+class RecordReader {
+public:
+    RecordReader(const char* data, size_t size)
+        : data_(data)
+        , size_(size)
+    {}
+
+    template <typename T>
+    T Get() {
+        T value;
+        memcpy(&value, Take(sizeof(value)), sizeof(value));
+        return value;
+    }
+
+    string_view GetText() {
+        const auto size = Get<uint32_t>();
+        return string_view(Take(size), size);
+    }
+
+    bool AtEnd() const {
+        return pos_ == size_;
+    }
+
+private:
+    const char* data_;
+    size_t size_;
+    size_t pos_ = 0;
+
+    const char* Take(size_t size) {
+        if (size_ - pos_ < size) {
+            throw runtime_error("WriteAheadLog: bad record"s);
+        }
+        const char* result = data_ + pos_;
+        pos_ += size;
+        return result;
+    }
+};
+
+LogRecord ParseRecord(const char* data, size_t size) {
+    RecordReader reader(data, size);
+    LogRecord record;
+    record.type = static_cast<LogRecordType>(reader.Get<uint8_t>());
+    switch (record.type) {
+    case LogRecordType::SET_STOP_WORDS:
+        record.text = reader.GetText();
+        break;
+    case LogRecordType::ADD_DOCUMENT:
+        record.document_id = reader.Get<int32_t>();
+        record.status = static_cast<DocumentStatus>(reader.Get<uint32_t>());
+        record.ratings.resize(reader.Get<uint32_t>());
+        for (int & rating : record.ratings) {
+            rating = reader.Get<int32_t>();
+        }
+        record.text = reader.GetText();
+        break;
+    case LogRecordType::REMOVE_DOCUMENT:
+        record.document_id = reader.Get<int32_t>();
+        break;
+    default:
+        throw runtime_error("WriteAheadLog: bad record"s);
+    }
+    if (!reader.AtEnd()) {
+        throw runtime_error("WriteAheadLog: bad record"s);
+    }
+    return record;
+}
+
+// Размер записи, начинающейся в data[pos], если она целая и её контрольная сумма верна
+optional<uint32_t> GetValidRecordSize(const vector<char>& data, size_t pos) {
+    if (data.size() - pos < RECORD_HEADER_SIZE) {
+        return nullopt;
+    }
+    uint32_t size = 0;
+    uint32_t checksum = 0;
+    memcpy(&size, data.data() + pos, sizeof(size));
+    memcpy(&checksum, data.data() + pos + sizeof(size), sizeof(checksum));
+    if (data.size() - pos - RECORD_HEADER_SIZE < size
+        || RecordChecksum(data.data() + pos + RECORD_HEADER_SIZE, size) != checksum) {
+        return nullopt;
+    }
+    return size;
+}
+
+vector<char> ReadSegment(const string& path) {
+    ifstream in(path, ios::binary);
+    if (!in) {
+        throw runtime_error("WriteAheadLog: cannot read '"s + path + "'"s);
+    }
+    vector<char> data{istreambuf_iterator<char>(in), istreambuf_iterator<char>()};
+    if (in.bad()) {
+        throw runtime_error("WriteAheadLog: cannot read '"s + path + "'"s);
+    }
+    return data;
+}
+
+void SyncDirectory(const string& directory) {
+    const int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+}
+
+WriteAheadLog::WriteAheadLog(string directory, Options options)
+    : directory_(move(directory))
+    , options_(options)
+    , last_sync_(chrono::steady_clock::now())
+{
+    filesystem::create_directories(directory_);
+    const vector<uint64_t> segments = ListSegments(directory_);
+    if (!segments.empty()) {
+        // запись, которую не успели дописать до падения, отрезается, чтобы
+        // последний файл не оказался повреждённым перед следующими
+        const string path = GetSegmentPath(directory_, segments.back());
+        const vector<char> data = ReadSegment(path);
+        const size_t valid_size = FindValidSize(path, data);
+        if (valid_size != data.size()) {
+            filesystem::resize_file(path, valid_size);
+        }
+    }
+    OpenSegment(segments.empty() ? 1 : segments.back() + 1);
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    try {
+        Commit(last_lsn_);
+    } catch (...) {
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+uint64_t WriteAheadLog::AppendSetStopWords(string_view text) {
+    lock_guard lock(mutex_);
+    const size_t record_start = BeginRecord(LogRecordType::SET_STOP_WORDS);
+    PutText(buffer_, text);
+    return EndRecord(record_start);
+}
+
+uint64_t WriteAheadLog::AppendAddDocument(int document_id, string_view text, DocumentStatus status,
+                                          const vector<int>& ratings) {
+    lock_guard lock(mutex_);
+    const size_t record_start = BeginRecord(LogRecordType::ADD_DOCUMENT);
+    Put(buffer_, static_cast<int32_t>(document_id));
+    Put(buffer_, static_cast<uint32_t>(status));
+    Put(buffer_, static_cast<uint32_t>(ratings.size()));
+    for (const int rating : ratings) {
+        Put(buffer_, static_cast<int32_t>(rating));
+    }
+    PutText(buffer_, text);
+    return EndRecord(record_start);
+}
+
+uint64_t WriteAheadLog::AppendRemoveDocument(int document_id) {
+    lock_guard lock(mutex_);
+    const size_t record_start = BeginRecord(LogRecordType::REMOVE_DOCUMENT);
+    Put(buffer_, static_cast<int32_t>(document_id));
+    return EndRecord(record_start);
+}
+
+void WriteAheadLog::Commit(uint64_t lsn) {
+    unique_lock lock(mutex_);
+    while (written_lsn_ < lsn) {
+        if (failed_) {
+            throw runtime_error("WriteAheadLog: log is unusable after a write error"s);
+        }
+        if (flushing_) {
+            flushed_.wait(lock);
+            continue;
+        }
+        // этот поток пишет записи всех потоков, накопленные к этому моменту
+        flushing_ = true;
+        vector<char> data;
+        data.swap(buffer_);
+        const uint64_t batch_lsn = last_lsn_;
+        const auto now = chrono::steady_clock::now();
+        const bool sync = options_.sync_policy == SyncPolicy::ON_COMMIT
+            || (options_.sync_policy == SyncPolicy::INTERVAL && now - last_sync_ >= options_.sync_interval);
+        lock.unlock();
+        exception_ptr error;
+        try {
+            WriteSegment(data, sync);
+        } catch (...) {
+            error = current_exception();
+        }
+        lock.lock();
+        flushing_ = false;
+        flushed_.notify_all();
+        if (error) {
+            failed_ = true;
+            rethrow_exception(error);
+        }
+        written_lsn_ = batch_lsn;
+        if (sync) {
+            last_sync_ = now;
+        }
+        if (segment_size_ >= options_.max_segment_size) {
+            OpenSegment(segment_number_ + 1);
+        }
+        // буфер с выделенной памятью возвращается для следующих записей
+        if (buffer_.empty()) {
+            data.clear();
+            buffer_.swap(data);
+        }
+    }
+}
+
+uint64_t WriteAheadLog::Rotate() {
+    unique_lock lock(mutex_);
+    flushed_.wait(lock, [this] {
+        return !flushing_;
+    });
+    if (failed_) {
+        throw runtime_error("WriteAheadLog: log is unusable after a write error"s);
+    }
+    try {
+        WriteSegment(buffer_, options_.sync_policy != SyncPolicy::NEVER);
+    } catch (...) {
+        failed_ = true;
+        throw;
+    }
+    buffer_.clear();
+    written_lsn_ = last_lsn_;
+    flushed_.notify_all();
+    OpenSegment(segment_number_ + 1);
+    return segment_number_;
+}
+
+void WriteAheadLog::Truncate(uint64_t first_segment) {
+    for (const uint64_t segment_number : ListSegments(directory_)) {
+        if (segment_number < first_segment) {
+            filesystem::remove(GetSegmentPath(directory_, segment_number));
+        }
+    }
+}
+
+void WriteAheadLog::Replay(const string& directory, uint64_t first_segment,
+                           const function<void(const LogRecord&)>& handler) {
+    vector<uint64_t> segments = ListSegments(directory);
+    segments.erase(segments.begin(), lower_bound(segments.begin(), segments.end(), first_segment));
+    for (size_t i = 0; i < segments.size(); ++i) {
+        const string path = GetSegmentPath(directory, segments[i]);
+        const vector<char> data = ReadSegment(path);
+        const size_t valid_size = FindValidSize(path, data);
+        // недописанная запись бывает только в последнем файле: после
+        // перезапуска запись идёт в новый файл
+        if (valid_size != data.size() && i + 1 != segments.size()) {
+            throw runtime_error("WriteAheadLog: damaged segment '"s + path + "'"s);
+        }
+        for (size_t pos = 0; pos < valid_size;) {
+            uint32_t size = 0;
+            memcpy(&size, data.data() + pos, sizeof(size));
+            handler(ParseRecord(data.data() + pos + RECORD_HEADER_SIZE, size));
+            pos += RECORD_HEADER_SIZE + size;
+        }
+    }
+}
+
+size_t WriteAheadLog::FindValidSize(const string& path, const vector<char>& data) {
+    size_t pos = 0;
+    while (pos < data.size()) {
+        const optional<uint32_t> size = GetValidRecordSize(data, pos);
+        if (!size) {
+            break;
+        }
+        pos += RECORD_HEADER_SIZE + *size;
+    }
+    if (pos == data.size() || data.size() - pos < RECORD_HEADER_SIZE) {
+        return pos;
+    }
+    // плохая запись - недописанный конец, если она доходит до конца файла
+    // или за ней нет целой записи; иначе повреждена середина файла
+    uint32_t size = 0;
+    memcpy(&size, data.data() + pos, sizeof(size));
+    const size_t next = pos + RECORD_HEADER_SIZE + size;
+    if (data.size() - pos - RECORD_HEADER_SIZE > size && GetValidRecordSize(data, next)) {
+        throw runtime_error("WriteAheadLog: damaged segment '"s + path + "'"s);
+    }
+    return pos;
+}
+
+size_t WriteAheadLog::BeginRecord(LogRecordType type) {
+    const size_t record_start = buffer_.size();
+    buffer_.resize(record_start + RECORD_HEADER_SIZE);
+    Put(buffer_, static_cast<uint8_t>(type));
+    return record_start;
+}
+
+uint64_t WriteAheadLog::EndRecord(size_t record_start) {
+    const char* payload = buffer_.data() + record_start + RECORD_HEADER_SIZE;
+    const auto size = static_cast<uint32_t>(buffer_.size() - record_start - RECORD_HEADER_SIZE);
+    const uint32_t checksum = RecordChecksum(payload, size);
+    memcpy(buffer_.data() + record_start, &size, sizeof(size));
+    memcpy(buffer_.data() + record_start + sizeof(size), &checksum, sizeof(checksum));
+    return ++last_lsn_;
+}
+
+void WriteAheadLog::WriteSegment(const vector<char>& data, bool sync) {
+    for (size_t written = 0; written < data.size();) {
+        const ssize_t result = write(fd_, data.data() + written, data.size() - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw runtime_error("WriteAheadLog: cannot write '"s + GetSegmentPath(directory_, segment_number_) + "'"s);
+        }
+        written += static_cast<size_t>(result);
+    }
+    segment_size_ += data.size();
+    if (sync && fdatasync(fd_) != 0) {
+        throw runtime_error("WriteAheadLog: cannot sync '"s + GetSegmentPath(directory_, segment_number_) + "'"s);
+    }
+}
+
+void WriteAheadLog::OpenSegment(uint64_t segment_number) {
+    const string path = GetSegmentPath(directory_, segment_number);
+    const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw runtime_error("WriteAheadLog: cannot create '"s + path + "'"s);
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+    fd_ = fd;
+    segment_number_ = segment_number;
+    segment_size_ = 0;
+    if (options_.sync_policy != SyncPolicy::NEVER) {
+        // новый файл должен сохраниться в каталоге вместе со своими записями
+        SyncDirectory(directory_);
+    }
+}
+
+string WriteAheadLog::GetSegmentPath(const string& directory, uint64_t segment_number) {
+    string number = to_string(segment_number);
+    // номера дополняются нулями, чтобы файлы сортировались по имени
+    number.insert(0, 20 - min<size_t>(number.size(), 20), '0');
+    return (filesystem::path(directory) / ("wal-"s + number + ".log"s)).string();
+}
+
+vector<uint64_t> WriteAheadLog::ListSegments(const string& directory) {
+    vector<uint64_t> segments;
+    if (!filesystem::exists(directory)) {
+        return segments;
+    }
+    for (const auto & entry : filesystem::directory_iterator(directory)) {
+        const string name = entry.path().filename().string();
+        if (name.size() == 28 && name.compare(0, 4, "wal-") == 0 && name.compare(24, 4, ".log") == 0
+            && all_of(name.begin() + 4, name.begin() + 24, [](char c) { return c >= '0' && c <= '9'; })) {
+            segments.push_back(stoull(name.substr(4, 20)));
+        }
+    }
+    sort(segments.begin(), segments.end());
+    return segments;
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "document.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class LogRecordType : uint8_t {
+    SET_STOP_WORDS,
+    ADD_DOCUMENT,
+    REMOVE_DOCUMENT,
+};
+
+// Запись журнала при восстановлении; text указывает в прочитанный файл
+// и действителен только внутри обработчика
+struct LogRecord {
+    LogRecordType type = LogRecordType::ADD_DOCUMENT;
+    int document_id = 0;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+    std::string_view text;
+};
+
+// Журнал изменений документов, только дописываемый. Записи копятся в буфере
+// и передаются в файл в Commit: поток, первым дошедший до Commit, пишет
+// записи всех потоков одним write и одним fsync (групповая фиксация), остальные
+// ждут его. Журнал состоит из файлов wal-<номер>.log; Rotate начинает новый
+// файл, после чего старые файлы можно удалить, сохранив снимок индекса.
+// Каждая запись: длина (uint32), контрольная сумма (uint32), данные.
+class WriteAheadLog {
+public:
+    enum class SyncPolicy {
+        // fsync не вызывается: записи переживают падение процесса, но не ОС
+        NEVER,
+        // fsync перед возвратом из каждого Commit
+        ON_COMMIT,
+        // fsync в Commit, если с предыдущего прошло не меньше sync_interval
+        INTERVAL,
+    };
+
+    struct Options {
+        SyncPolicy sync_policy = SyncPolicy::ON_COMMIT;
+        std::chrono::milliseconds sync_interval{100};
+        // файл больше этого размера сменяется следующим
+        size_t max_segment_size = 64 * 1024 * 1024;
+    };
+
+    // Открывает для записи новый файл журнала в directory, после уже имеющихся.
+    // Недописанную при падении запись в конце последнего файла отрезает.
+    WriteAheadLog(std::string directory, Options options);
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+    ~WriteAheadLog();
+
+    // Добавляют запись в буфер и возвращают её номер для Commit. Вызывающий
+    // упорядочивает вызовы так же, как применение изменений.
+    uint64_t AppendSetStopWords(std::string_view text);
+    uint64_t AppendAddDocument(int document_id, std::string_view text, DocumentStatus status,
+                               const std::vector<int>& ratings);
+    uint64_t AppendRemoveDocument(int document_id);
+
+    // Возвращает, когда записи до lsn включительно переданы в файл и, если
+    // требует политика, сохранены на диск. Бросает runtime_error при ошибке записи.
+    void Commit(uint64_t lsn);
+
+    // Сохраняет буфер и начинает новый файл. Возвращает его номер: записи
+    // из файлов с меньшими номерами сделаны до вызова.
+    uint64_t Rotate();
+
+    // Удаляет файлы журнала с номерами меньше first_segment
+    void Truncate(uint64_t first_segment);
+
+    // Передаёт handler записи файлов с номерами не меньше first_segment по
+    // порядку; файлы не изменяет. Недописанная при падении запись в конце
+    // последнего файла пропускается; повреждение в другом месте, в том числе
+    // плохая запись, за которой идут целые, - runtime_error.
+    static void Replay(const std::string& directory, uint64_t first_segment,
+                       const std::function<void(const LogRecord&)>& handler);
+
+private:
+    std::string directory_;
+    Options options_;
+
+    std::mutex mutex_;
+    std::condition_variable flushed_;
+    // записи, ещё не переданные в файл
+    std::vector<char> buffer_;
+    uint64_t last_lsn_ = 0;
+    // записи до этого номера переданы в файл
+    uint64_t written_lsn_ = 0;
+    // какой-то поток сейчас пишет буфер в файл
+    bool flushing_ = false;
+    // после ошибки записи неизвестно, что попало в файл, и журнал не принимает Commit
+    bool failed_ = false;
+    std::chrono::steady_clock::time_point last_sync_;
+
+    int fd_ = -1;
+    uint64_t segment_number_ = 0;
+    size_t segment_size_ = 0;
+
+    // Начинает запись: резервирует место под длину и контрольную сумму
+    size_t BeginRecord(LogRecordType type);
+    uint64_t EndRecord(size_t record_start);
+
+    // Пишет data в текущий файл, при sync - с fsync
+    void WriteSegment(const std::vector<char>& data, bool sync);
+
+    void OpenSegment(uint64_t segment_number);
+
+    static std::string GetSegmentPath(const std::string& directory, uint64_t segment_number);
+
+    // Длина начала data из целых записей без недописанного конца; бросает
+    // runtime_error, если за плохой записью идут целые
+    static size_t FindValidSize(const std::string& path, const std::vector<char>& data);
+
+    // Номера файлов журнала в directory по возрастанию
+    static std::vector<uint64_t> ListSegments(const std::string& directory);
+};